@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <time.h>
 #include <ADB.h>
 #include <mysql/mysql.h>
 #include <syslog.h>
@@ -40,57 +41,90 @@ static  char    *OGHost  = NULL;
 static  char    *OGDBase = NULL;
 static  char    *OGUser  = NULL;
 static  char    *OGPass  = NULL;
-static  int     ADBDebug = 0;
 static  int     ADBRetry = 3;
 static  bool    ADBUseSyslog = true;
 static  bool    ADBUseStdErr = true;
 static  bool    ADBLogUpdates = false;
 static  bool    ADBEmptyDatesAsNULL = false;
+static  bool    ADBZeroCopyRows = false;
+
+// Non-static so the ADBDebugMsg macro can check it inline.
+int     ADBDebug = 0;
+
+// Each thread formats its log messages into its own buffer.
+static  __thread char ADBLogBuf[ADB_MAXLOGMSG];
 
 
 /*
-** ADBLogMsg    - Logs a message from one of the database modules.
-**                Will determine where to send the message and then send it.
+** ADBLogOutput - Sends a formatted message to syslog and/or stderr on the
+**                calling thread.
 */
 
-void ADBLogMsg(int priority, const char *format, ... )
+void ADBLogOutput(int priority, const char *msg)
 {
-    // Make the query string from the variable arguments...
-    va_list ap;
-    va_start(ap, format);
-    char    *outstr = new char[265536];
-    vsprintf(outstr, format, ap);
-
     if (ADBUseSyslog) {
-        syslog(priority, "%s", outstr);
+        syslog(priority, "%s", msg);
     }
     
     if (ADBUseStdErr) {
-        fprintf(stderr, "%s\n", outstr);
+        fprintf(stderr, "%s\n", msg);
         fflush(stderr);
     }
+}
+
+/*
+** ADBLogWrite  - Hands a formatted message to the asynchronous sink if it
+**                is running, otherwise writes it directly.
+*/
 
-    delete outstr;
+static void ADBLogWrite(int priority, const char *msg)
+{
+    if (!ADBLog::push(priority, msg)) ADBLogOutput(priority, msg);
 }
 
 /*
-** ADBDebugMsg - Logs a message from one of the database modules.
-**               Will determine where to send the message and then send it.
+** ADBNowMsecs  - Returns a monotonic clock in milliseconds, for batched
+**                commits, so that changes to the system time don't hold
+**                off or hurry a commit.
 */
 
-void ADBDebugMsg(int level, const char *format, ... )
+static llong ADBNowMsecs(void)
 {
-    // Make the query string from the variable arguments...
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (llong) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+** ADBLogMsg    - Logs a message from one of the database modules.
+**                Will determine where to send the message and then send it.
+*/
+
+void ADBLogMsg(int priority, const char *format, ... )
+{
+    // Make the message string from the variable arguments...
     va_list ap;
     va_start(ap, format);
-    char    *outstr = new char[265536];
-    vsprintf(outstr, format, ap);
+    vsnprintf(ADBLogBuf, sizeof(ADBLogBuf), format, ap);
+    va_end(ap);
 
-    if (ADBDebug >= level) {
-        ADBLogMsg(LOG_DEBUG, outstr);
-    }
+    ADBLogWrite(priority, ADBLogBuf);
+}
 
-    delete outstr;
+/*
+** ADBDebugLog  - Logs a debug message from one of the database modules.
+**                Call this through the ADBDebugMsg macro, which checks the
+**                debug level first.
+*/
+
+void ADBDebugLog(const char *format, ... )
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(ADBLogBuf, sizeof(ADBLogBuf), format, ap);
+    va_end(ap);
+
+    ADBLogWrite(LOG_DEBUG, ADBLogBuf);
 }
 
 
@@ -104,8 +138,11 @@ ADB::ADB(
     
     // Set the debug level
     debugLevel = ADBDebug;
+    DBPass     = NULL;
+    pooledConn = false;
     curRow.setDebugLevel(debugLevel);
     curRow.setZeroDatesAsNULL(ADBEmptyDatesAsNULL);
+    curRow.setZeroCopy(ADBZeroCopyRows);
     
     // Setup the DBHost value, based on passed in arguments or global settings.
     if (Host == NULL) {
@@ -163,14 +200,21 @@ ADB::ADB(
         strcpy(DBPass, Pass);
     }
     
-    // Initialize the MySQL structure
-    mysql_init(&MyConn);
+    // Initialize the MySQL structure, unless we will be borrowing one.
+    if (ADBPool::enabled()) pooledConn = true;
+    else mysql_init(&MyConn);
 
     int tryNo = 0;
     while (tryNo < ADBRetry) {
         connected = 0;
         ADBDebugMsg(1, "ADB: Connecting to %s as %s, pw %s...", DBHost, DBUser, DBPass);
-        if (!(MySock = mysql_real_connect(&MyConn, DBHost, DBUser, DBPass, NULL,0,NULL,0))) {
+        if (pooledConn) {
+            // The pool does its own connect and select_db on a miss.
+            if ((MySock = ADBPool::acquire(DBHost, DBUser, DBPass, DBName))) {
+                connected = 1;
+                tryNo = ADBRetry + 1;
+            }
+        } else if (!(MySock = mysql_real_connect(&MyConn, DBHost, DBUser, DBPass, NULL,0,NULL,0))) {
             ADBLogMsg(LOG_ERR, "ADB: Unable to connect to the database server on %s as %s.", DBHost, DBUser);
             // exit(-1);
         } else {
@@ -196,9 +240,20 @@ ADB::ADB(
     // connected  = 1;
     // Set our initial pointers to NULL
     queryRes   = NULL;
+    streaming  = 0;
+    stmtCache  = NULL;
+
+    // No transaction until begin() or setCommitBatch().
+    txnOpen         = 0;
+    txnScopes       = 0;
+    txnStatements   = 0;
+    txnStarted      = 0;
+    batchStatements = 0;
+    batchMsecs      = 0;
     
     // Setup our escape string so we can free() it safely.
-    escWorkStr = (char *) calloc(16, sizeof(char));
+    escWorkStr  = (char *) calloc(16, sizeof(char));
+    escWorkSize = 16;
 
 }
 
@@ -207,6 +262,10 @@ ADB::ADB(
 
 ADB::~ADB()
 {
+    // Don't hand a connection back to the pool in the middle of a
+    // transaction.
+    closeTransaction();
+
     ADBDebugMsg(7, "ADB: Freeing query results...");
     // Free the last query result if it exists...
     if (queryRes != NULL) { 
@@ -215,8 +274,14 @@ ADB::~ADB()
     
     ADBDebugMsg(7, "ADB: closing MySQL socket...");
 	if (connected) {
-	    // And disconnect from the database.
-    	mysql_close(MySock);
+	    // And disconnect from the database, or hand the connection back
+	    // to the pool for the next ADB object.
+	    if (pooledConn) {
+	        ADBPool::release(MySock);
+	    } else {
+	        ADBStmtCache::dropConnection(MySock);
+    	    mysql_close(MySock);
+    	}
     }
     
     // Free our escape work string.
@@ -343,6 +408,16 @@ void ADB::recordUpdates(bool newVal)
     ADBLogUpdates = newVal;
 }
 
+/*
+** recordingUpdates - Returns true if commands that modify the database are
+**                    being sent to syslog.
+*/
+
+bool ADB::recordingUpdates(void)
+{
+    return ADBLogUpdates;
+}
+
 /*
 ** returnEmptyDatesAsNULL - Determines whether we will return '0' dates
 **                          as '0000-00-00' or as ''.
@@ -353,6 +428,16 @@ void ADB::returnEmptyDatesAsNULL(bool newVal)
     ADBEmptyDatesAsNULL = newVal;
 }
 
+/*
+** useZeroCopyRows - Determines whether new ADB objects load their rows in
+**                   zero copy mode.  See ADBRow::setZeroCopy().
+*/
+
+void ADB::useZeroCopyRows(bool newVal)
+{
+    ADBZeroCopyRows = newVal;
+}
+
 /*
 ** Connected   - Returns 0 if we are not connected, 1 if we are.
 */
@@ -375,8 +460,10 @@ int ADB::query(const char *format, ... )
     vsprintf(querystr, format, ap);
 
     // Free the last query result.
+    drainStream("query()");
     if (queryRes != NULL) { 
         mysql_free_result(queryRes);
+        queryRes = NULL;
     }
     
     // Clear our current row...
@@ -398,6 +485,55 @@ int ADB::query(const char *format, ... )
 }
 
 
+/*
+** queryColumns - Performs a query and loads the result into an
+**                ADBResultSet.  The rows are pulled from the server with
+**                mysql_use_result() as they are parsed, so the result is
+**                never held as rows and columns at the same time.
+**
+**                Returns 1 if the query was successful.
+*/
+
+int ADB::queryColumns(ADBResultSet *resultSet, const char *format, ... )
+{
+    // Make the query string from the variable arguments...
+    int     retVal = 0;
+    va_list ap;
+    va_start(ap, format);
+    char    *querystr = new char[265536];
+    vsnprintf(querystr, 265536, format, ap);
+    va_end(ap);
+
+    // Free the last query result.
+    drainStream("queryColumns()");
+    if (queryRes != NULL) { 
+        mysql_free_result(queryRes);
+        queryRes = NULL;
+    }
+    curRow.clearRow();
+    resultSet->clear();
+    rowCount = 0;
+    
+    ADBDebugMsg(2, "ADB: Performing columnar query '%s'", querystr);
+
+    MYSQL_RES   *res = NULL;
+    if (mysql_query(MySock, querystr) || !(res = mysql_use_result(MySock))) {
+        ADBLogMsg(LOG_ERR, "ADB: MySQL error on query.  Query: '%s', Error: '%s'", querystr, mysql_error(MySock));
+    } else {
+        rowCount = resultSet->load(res);
+        if (mysql_errno(MySock)) {
+            ADBLogMsg(LOG_ERR, "ADB: MySQL error while reading rows after row %ld: '%s'", rowCount, mysql_error(MySock));
+        } else {
+            retVal = 1;
+        }
+        mysql_free_result(res);
+        ADBDebugMsg(1, "ADB: columnar query returned %ld rows.", rowCount);
+    }
+    delete [] querystr;
+    return retVal;
+}
+
+
 /*
 ** sumFloat - Do a query on the database which will return a "SUM()".
 **            This is seperate because of the way that the new MySQL
@@ -414,9 +550,14 @@ float ADB::sumFloat(const char *format, ... )
     vsprintf(querystr, format, ap);
 
     // Free the last query result.
+    drainStream("sumFloat()");
     if (queryRes != NULL) { 
         mysql_free_result(queryRes);
+        queryRes = NULL;
     }
+    
+    // Clear our current row...
+    curRow.clearRow();
 
     // Do the query.
     if (mysql_query(MySock, querystr) || !(queryRes = mysql_store_result(MySock))) {
@@ -442,11 +583,144 @@ float ADB::sumFloat(const char *format, ... )
 
 int ADB::getrow(void)
 {
+    if (!queryRes) return 0;
+
     int RetVal = curRow.loadRow(queryRes);
+    if (streaming) {
+        if (RetVal) {
+            rowCount++;
+        } else {
+            // End of the stream, or the connection failed part way
+            // through.  Either way, release the result so the connection
+            // can be used again.  The last row loaded stays in curRow,
+            // except with zero copy rows, which pointed into the result
+            // and have been emptied.
+            if (mysql_errno(MySock)) {
+                ADBLogMsg(LOG_ERR, "ADB: MySQL error while streaming rows after row %ld: '%s'", rowCount, mysql_error(MySock));
+            }
+            mysql_free_result(queryRes);
+            queryRes  = NULL;
+            streaming = 0;
+            ADBDebugMsg(1, "ADB: stream returned %ld rows.", rowCount);
+        }
+    }
     ADBDebugMsg(1, "ADB::getrow() returning %d", RetVal);
     return RetVal;
 }
 
+/*
+** queryStream - Performs a query using mysql_use_result() so that rows
+**               are read from the server as getrow() asks for them rather
+**               than all being held in client memory.
+**
+**               Returns 1 if the query was successful.
+*/
+
+int ADB::queryStream(const char *format, ... )
+{
+    // Make the query string from the variable arguments...
+    int     retVal = 0;
+    va_list ap;
+    va_start(ap, format);
+    char    *querystr = new char[265536];
+    vsnprintf(querystr, 265536, format, ap);
+    va_end(ap);
+
+    // Free the last query result.
+    drainStream("queryStream()");
+    if (queryRes != NULL) { 
+        mysql_free_result(queryRes);
+        queryRes = NULL;
+    }
+    
+    // Clear our current row...
+    curRow.clearRow();
+    rowCount = 0;
+    
+    ADBDebugMsg(2, "ADB: Performing streaming query '%s'", querystr);
+
+    // Do the query.
+    if (mysql_query(MySock, querystr) || !(queryRes = mysql_use_result(MySock))) {
+        ADBLogMsg(LOG_ERR, "ADB: MySQL error on query.  Query: '%s', Error: '%s'", querystr, mysql_error(MySock));
+    } else {
+        streaming = 1;
+        retVal    = 1;
+    }
+    delete [] querystr;
+    return retVal;
+}
+
+/*
+** streamOpen - Returns 1 if a queryStream() is still returning rows.
+*/
+
+int ADB::streamOpen(void)
+{
+    return streaming;
+}
+
+/*
+** endStream - Discards any rows left in an open stream.  The server
+**             won't accept another command on this connection until the
+**             stream has been read to the end.
+*/
+
+void ADB::endStream(void)
+{
+    if (!streaming) return;
+
+    ADBDebugMsg(1, "ADB: Closing stream after %ld rows", rowCount);
+    if (queryRes) {
+        // mysql_free_result() reads and throws away the rest of the rows.
+        mysql_free_result(queryRes);
+        queryRes = NULL;
+    }
+    streaming = 0;
+}
+
+/*
+** drainStream - Called before anything else is sent to the server.  If the
+**               caller left a stream open, warn about it and drain it.
+*/
+
+void ADB::drainStream(const char *caller)
+{
+    if (!streaming) return;
+
+    ADBLogMsg(LOG_WARNING, "ADB::%s - Streaming query still open after %ld rows, discarding the rest", caller, rowCount);
+    endStream();
+}
+
+/*
+** getEpochs - Converts one date/time column of the whole result into an
+**             array of epoch seconds, straight from the MYSQL_ROWs so no
+**             ADBColumn is loaded along the way.
+*/
+
+long ADB::getEpochs(uint colNo, llong *epochs)
+{
+    if (!queryRes || streaming) {
+        ADBLogMsg(LOG_WARNING, "ADB::getEpochs() - No stored query result to convert");
+        return -1;
+    }
+    if (colNo >= mysql_num_fields(queryRes)) {
+        ADBLogMsg(LOG_WARNING, "ADB::getEpochs() - Column %d is out of range", colNo);
+        return -1;
+    }
+
+    MYSQL_ROW_OFFSET    savedPos = mysql_row_tell(queryRes);
+    MYSQL_ROW           row;
+    long                retVal = 0;
+
+    mysql_data_seek(queryRes, 0);
+    while ((row = mysql_fetch_row(queryRes))) {
+        ulong *lengths = mysql_fetch_lengths(queryRes);
+        epochs[retVal++] = row[colNo] ? ADBDateTimeToEpoch(row[colNo], lengths[colNo]) : 0;
+    }
+    mysql_row_seek(queryRes, savedPos);
+    return retVal;
+}
+
 // dbcmd - Execute a command on the database we're connected to.
 
 long ADB::dbcmd(const char *format, ... )
@@ -461,8 +735,11 @@ long ADB::dbcmd(const char *format, ... )
 
 	long	Ret = 0;
 
+    // A stream still being read blocks the connection.
+    drainStream("dbcmd()");
+
     // Do the command
-    if (ADBLogUpdates) syslog(LOG_DEBUG, "ADB::dbcmd[%s]: %s", DBUser, cmdstr);
+    recordUpdate(cmdstr);
     mysql_query(MySock, cmdstr);
     Ret = mysql_insert_id(MySock);
     if (Ret < 0) {
@@ -475,17 +752,281 @@ long ADB::dbcmd(const char *format, ... )
 }
 
 /*
-** escapeString  - An interface into the MySQL escape_string function.
+** rawcmd   - Sends a command to the server exactly as given.  Used for
+**            commands that may be too large for dbcmd() to format.
+**
+**            Returns the insert id, or -1 on error.
+*/
+
+long ADB::rawcmd(const char *cmd, ulong cmdLen)
+{
+    long    Ret = 0;
+
+    ADBDebugMsg(1, "ADB: raw command of %lu bytes", cmdLen);
+
+    // A stream still being read blocks the connection.
+    drainStream("rawcmd()");
+
+    recordUpdate(cmd);
+    if (mysql_real_query(MySock, cmd, cmdLen)) {
+        ADBLogMsg(LOG_ERR, "ADB: MySQL error on command.  Command: '%.256s...', Error: '%s'", cmd, mysql_error(MySock));
+        return -1;
+    }
+    Ret = mysql_insert_id(MySock);
+
+    ADBDebugMsg(1, "ADB: command returning value %ld", Ret);
+    return(Ret);
+}
+
+/*
+** recordUpdate - Sends a command that modifies the database to syslog if
+**                recordUpdates() has been turned on.  Called just before
+**                the command is sent, so it also counts the command toward
+**                the open transaction and commits a full batch first.
+*/
+
+void ADB::recordUpdate(const char *cmd)
+{
+    if (ADBLogUpdates) syslog(LOG_DEBUG, "ADB::dbcmd[%s]: %s", DBUser, cmd);
+    if (!txnOpen) return;
+
+    // An ADBTransaction guard holds the batch open until it is done.
+    if ((batchStatements || batchMsecs) && txnStatements && !txnScopes) {
+        if ((batchStatements && txnStatements >= batchStatements) ||
+            (batchMsecs && ADBNowMsecs() - txnStarted >= (llong) batchMsecs)) {
+            ADBDebugMsg(3, "ADB: Committing a batch of %lu statements", txnStatements);
+            endTransaction(1);
+            startTransaction();
+        }
+    }
+    if (txnOpen) txnStatements++;
+}
+
+/*
+** begin - Starts a transaction.  The statements sent through this object
+**         aren't committed until commit() is called.
+*/
+
+int ADB::begin(void)
+{
+    if (txnOpen) {
+        ADBLogMsg(LOG_WARNING, "ADB::begin() - A transaction is already open");
+        return 0;
+    }
+    return startTransaction();
+}
+
+/*
+** commit - Commits the open transaction.  When batching, the next batch
+**          is started straight away.
+*/
+
+int ADB::commit(void)
+{
+    if (!txnOpen) {
+        ADBLogMsg(LOG_WARNING, "ADB::commit() - No transaction is open");
+        return 0;
+    }
+    int ret = endTransaction(1);
+    if (batchStatements || batchMsecs) startTransaction();
+    return ret;
+}
+
+/*
+** rollback - Throws away the open transaction.  When batching, only the
+**            statements since the last batch was committed are lost.
+*/
+
+int ADB::rollback(void)
+{
+    if (!txnOpen) {
+        ADBLogMsg(LOG_WARNING, "ADB::rollback() - No transaction is open");
+        return 0;
+    }
+    int ret = endTransaction(0);
+    if (batchStatements || batchMsecs) startTransaction();
+    return ret;
+}
+
+/*
+** inTransaction - Returns 1 if a transaction (or batch) is open.
+*/
+
+int ADB::inTransaction(void)
+{
+    return txnOpen;
+}
+
+/*
+** savepoint, rollbackTo, releaseSavepoint - Sets a savepoint in the open
+**                                           transaction, rolls back to
+**                                           one, or forgets one.
+*/
+
+int ADB::savepoint(const char *name)
+{
+    return savepointCmd("SAVEPOINT", name);
+}
+
+int ADB::rollbackTo(const char *name)
+{
+    return savepointCmd("ROLLBACK TO SAVEPOINT", name);
+}
+
+int ADB::releaseSavepoint(const char *name)
+{
+    return savepointCmd("RELEASE SAVEPOINT", name);
+}
+
+/*
+** setCommitBatch - Turns batched commits on or off.  If a transaction is
+**                  already open when batching is turned on, it becomes
+**                  the first batch.
+*/
+
+int ADB::setCommitBatch(ulong maxStatements, ulong maxMsecs)
+{
+    int wasBatching = batchStatements || batchMsecs;
+
+    batchStatements = maxStatements;
+    batchMsecs      = maxMsecs;
+    if (maxStatements || maxMsecs) {
+        if (txnOpen) return 1;
+        return startTransaction();
+    }
+    if (wasBatching && txnOpen) return endTransaction(1);
+    return 1;
+}
+
+/*
+** transactionDone - Called after a transaction ends.  Nothing to do here.
+*/
+
+void ADB::transactionDone(int, ulong)
+{
+}
+
+/*
+** closeTransaction - Ends any transaction still open before the object
+**                    goes away.  A batch is committed, anything else is
+**                    rolled back.  Subclasses call this from their own
+**                    destructors so their transactionDone() still runs.
+*/
+
+void ADB::closeTransaction(void)
+{
+    if (!txnOpen || !connected) return;
+
+    if (batchStatements || batchMsecs) {
+        batchStatements = 0;
+        batchMsecs      = 0;
+        endTransaction(1);
+    } else {
+        ADBLogMsg(LOG_WARNING, "ADB: Rolling back a transaction of %lu statements that was never committed", txnStatements);
+        endTransaction(0);
+    }
+}
+
+/*
+** startTransaction - Sends START TRANSACTION and resets the batch limits.
+*/
+
+int ADB::startTransaction(void)
+{
+    if (!connected) return 0;
+
+    drainStream("begin()");
+    if (mysql_query(MySock, "START TRANSACTION")) {
+        ADBLogMsg(LOG_ERR, "ADB: Unable to start a transaction: %s", mysql_error(MySock));
+        return 0;
+    }
+    txnOpen       = 1;
+    txnStatements = 0;
+    txnStarted    = ADBNowMsecs();
+    return 1;
+}
+
+/*
+** endTransaction - Commits or rolls back the open transaction.
+*/
+
+int ADB::endTransaction(int doCommit)
+{
+    ulong   statements = txnStatements;
+    int     ret;
+
+    drainStream(doCommit ? "commit()" : "rollback()");
+    ret = doCommit ? !mysql_commit(MySock) : !mysql_rollback(MySock);
+    if (!ret) {
+        ADBLogMsg(LOG_ERR, "ADB: Unable to %s a transaction of %lu statements: %s", doCommit ? "commit" : "roll back", statements, mysql_error(MySock));
+    }
+    txnOpen       = 0;
+    txnStatements = 0;
+
+    // A failed commit may still have gone through, so let subclasses
+    // treat it as committed.
+    transactionDone(doCommit, statements);
+    return ret;
+}
+
+/*
+** savepointCmd - Sends one of the savepoint commands.  The name has to
+**                be a plain identifier since it can't be quoted.
+*/
+
+int ADB::savepointCmd(const char *verb, const char *name)
+{
+    if (!txnOpen) {
+        ADBLogMsg(LOG_WARNING, "ADB: %s with no transaction open", verb);
+        return 0;
+    }
+
+    size_t  nameLen = name ? strlen(name) : 0;
+    if (!nameLen || nameLen > 64 || strspn(name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") != nameLen) {
+        ADBLogMsg(LOG_WARNING, "ADB: Invalid savepoint name '%s'", name ? name : "(null)");
+        return 0;
+    }
+
+    char    cmd[128];
+    snprintf(cmd, sizeof(cmd), "%s %s", verb, name);
+    drainStream("savepoint()");
+    if (mysql_query(MySock, cmd)) {
+        ADBLogMsg(LOG_ERR, "ADB: %s failed: %s", cmd, mysql_error(MySock));
+        return 0;
+    }
+    return 1;
+}
+
+/*
+** statements - Returns the prepared statement cache for our connection.
+*/
+
+ADBStmtCache *ADB::statements()
+{
+    if (!stmtCache && connected && ADBStmtCache::enabled()) {
+        stmtCache = ADBStmtCache::forConnection(MySock);
+    }
+    return stmtCache;
+}
+
+/*
+** escapeString  - Escapes a string for use in a query.  The result is
+**                 good until the next call.
 */
 
 const char *ADB::escapeString(const char *src, int truncLen)
 {
-    int tmpLen = 50;
-    if ((src) && strlen(src)) tmpLen = strlen(src);
-    free(escWorkStr);
-    escWorkStr = (char *) calloc((tmpLen+1) * 2, sizeof(char));
-    if (truncLen < tmpLen) tmpLen = truncLen;
-    if (src) mysql_escape_string(escWorkStr, src, tmpLen);
+    ulong   srcLen = 0;
+    if (src) srcLen = strlen(src);
+    if (truncLen >= 0 && (ulong) truncLen < srcLen) srcLen = truncLen;
+
+    // The work string only ever grows.
+    if (srcLen * 2 + 1 > escWorkSize) {
+        free(escWorkStr);
+        escWorkSize = srcLen * 2 + 1;
+        escWorkStr  = (char *) calloc(escWorkSize, sizeof(char));
+    }
+    ADBEscapeString(escWorkStr, src ? src : "", srcLen);
     return escWorkStr;
 }
 
@@ -79,16 +79,205 @@
 #define ullong unsigned long long
 #endif
 
+// MySQL 8 dropped the my_bool typedef that the statement API used.
+#if defined(MYSQL_VERSION_ID) && MYSQL_VERSION_ID >= 80001 && !defined(MARIADB_BASE_VERSION)
+typedef bool my_bool;
+#endif
+
 
 // For speed we pre-allocate enough space to hold column definitions
 // up to this number of definitions.
 #define ADB_MAXCOLS     128
 #define ADB_MAXCOLWIDTH 128
 
+// Type mismatch warnings ADBColumn has already given for a column.  Each
+// one is only logged once per column so a loop can't flood the logs.
+#define ADB_WARN_INT        0x0001
+#define ADB_WARN_LONG       0x0002
+#define ADB_WARN_LLONG      0x0004
+#define ADB_WARN_FLOAT      0x0008
+#define ADB_WARN_TIME_T     0x0010
+#define ADB_WARN_QDATE      0x0020
+#define ADB_WARN_QTIME      0x0040
+#define ADB_WARN_QDATETIME  0x0080
+
+// Which forms of an ADBColumn's value are current.
+#define ADB_VAL_TEXT        0x0001
+#define ADB_VAL_INT         0x0002
+#define ADB_VAL_DBL         0x0004
+
+// Values up to this long (including the trailing NUL) are kept inside the
+// ADBColumn itself rather than in an allocated buffer.
+#define ADB_COLINLINE       32
+
+// Heap buffers a column grew to hold a long value are kept for the next
+// value unless they are bigger than this.
+#define ADB_COLHEAPKEEP     65536
+
+// The size of the blocks an ADBArena allocates, and the most it will hold
+// before it starts refusing requests.
+#define ADB_ARENA_BLOCK     65536
+#define ADB_ARENA_MAX       (16 * 1024 * 1024)
+
+// The kinds of column an ADBResultSet holds.
+#define ADB_RS_INT          1
+#define ADB_RS_DOUBLE       2
+#define ADB_RS_TIME         3
+#define ADB_RS_STRING       4
+
+// The comparisons ADBResultSet::filter() can make.
+#define ADB_RS_EQ           1
+#define ADB_RS_NE           2
+#define ADB_RS_LT           3
+#define ADB_RS_LE           4
+#define ADB_RS_GT           5
+#define ADB_RS_GE           6
+
+// The scanners ADBEscapeString() can use to find bytes needing escaping.
+#define ADB_ESCAPE_SCALAR   0
+#define ADB_ESCAPE_SSE2     1
+#define ADB_ESCAPE_AVX2     2
+
+// The number of 64 bit words needed for a bitmask with one bit per column.
+#define ADB_COLMASK_WORDS   ((ADB_MAXCOLS + 63) / 64)
+
+// What ADBTable::upsert() did.
+#define ADB_UPSERT_FAILED       0
+#define ADB_UPSERT_INSERTED     1
+#define ADB_UPSERT_UPDATED      2
+#define ADB_UPSERT_UNCHANGED    3
+
+// How many keys ADBTable::getMany() and delMany() put in each statement.
+#define ADB_MANYKEYS_CHUNK      1000
+
+// When the server may store something other than what ADBTable sent it
+// for a column.  Kept in the schema cache from SHOW COLUMNS' Default and
+// Extra.
+#define ADB_SRVSET_AUTOINC      1       // auto_increment
+#define ADB_SRVSET_DEFAULT      2       // DEFAULT CURRENT_TIMESTAMP, etc.
+#define ADB_SRVSET_ONUPDATE     4       // ON UPDATE CURRENT_TIMESTAMP
+#define ADB_SRVSET_GENERATED    8       // VIRTUAL/STORED generated columns
+
+// What ADBTable::ins() and upd() do once the row is saved.  FULL reloads
+// the whole row.  MINIMAL fills in the auto increment key from the insert
+// id, keeps the values we sent and reloads only the columns the server
+// may have set itself, skipping the reload if there are none.
+#define ADB_AUTOGET_NONE        0
+#define ADB_AUTOGET_FULL        1
+#define ADB_AUTOGET_MINIMAL     2
+
+
+// The longest log message we'll format.  Anything longer is truncated.
+#define ADB_MAXLOGMSG   16384
+
+// The longest message the asynchronous log sink will queue.
+#define ADB_LOGRECSIZE  1024
+
+// What the asynchronous log sink does when its ring is full.
+#define ADB_LOG_DROP    0
+#define ADB_LOG_BLOCK   1
 
 // Logging/Debugging functions
 void    ADBLogMsg(int priority, const char *format, ... );
-void    ADBDebugMsg(int level,  const char *format, ... );
+void    ADBDebugLog(const char *format, ... );
+void    ADBLogOutput(int priority, const char *msg);
+
+// Converts a MySQL DATETIME or TIMESTAMP string, in local time, to seconds
+// since the epoch without calling mktime() for every value.
+llong   ADBDateTimeToEpoch(const char *src, ulong len);
+
+// Converts a number as MySQL sends it to a double.  Plain decimals are
+// converted directly, anything else is handed to strtod().  src must be
+// NUL terminated at len.
+double  ADBStrToDouble(const char *src, ulong len);
+
+// Writes a long long as decimal text into buf, which must hold at least
+// 21 characters.  Returns the length.
+int     ADBFormatLLong(char *buf, llong val);
+
+// Escapes len bytes of from for MySQL, the same way mysql_escape_string()
+// does.  to must hold len * 2 + 1 bytes.  Returns the escaped length.
+ulong   ADBEscapeString(char *to, const char *from, ulong len);
+
+// The scanner ADBEscapeString() uses.  It starts out as the fastest one the
+// CPU supports; setting it is only useful for testing and benchmarks.
+int     ADBGetEscapeLevel(void);
+int     ADBSetEscapeLevel(int newLevel);
+
+// The current debug level, set by ADB::setDebugLevel().  ADBDebugMsg
+// checks it before evaluating its arguments, so a disabled debug message
+// costs a single compare.
+extern  int     ADBDebug;
+#define ADBDebugMsg(level, ...) \
+    do { if (ADBDebug >= (level)) ADBDebugLog(__VA_ARGS__); } while (0)
+
+/*
+** ADBStmtBuf - A growable buffer that SQL statements are built in.  Text
+**              is appended at the end without rescanning what is already
+**              there, and column values are escaped straight into it.
+**              clear() keeps the memory so a buffer can be reused for
+**              the next statement.  The contents are always NUL
+**              terminated.
+*/
+
+class ADBStmtBuf
+{
+public:
+    ADBStmtBuf();
+    ~ADBStmtBuf();
+
+    void        clear();
+    void        truncate(ulong newLen);
+
+    void        append(char ch);
+    void        append(const char *str);
+    void        append(const char *str, ulong strLen);
+    void        appendLLong(llong val);
+    void        appendDouble(double val);
+    void        appendQuoted(const char *str, ulong strLen);
+
+    // For writing into the buffer directly: reserve() makes room for
+    // count more bytes and returns where they go, and advance() adds the
+    // bytes actually written to the length.
+    char        *reserve(ulong count);
+    void        advance(ulong count);
+
+    const char  *data();
+    ulong       length();
+
+private:
+    char        *buf;
+    ulong       len;
+    ulong       size;
+};
+
+
+/*
+** ADBArena - A bump allocator for column data.  Memory is handed out of
+**            large blocks and is all given back at once by reset(), which
+**            keeps the blocks around for the next round.  ADBTable gives
+**            one to its columns so that loading a row doesn't touch the
+**            heap once the blocks are big enough for the rows being read.
+*/
+
+struct ADBArenaBlock;
+
+class ADBArena
+{
+public:
+    ADBArena();
+    ~ADBArena();
+
+    void    *alloc(ulong size);
+    void    reset();
+    ulong   size();
+
+private:
+    ADBArenaBlock   *blocks;
+    ADBArenaBlock   *curBlock;
+    ulong           totalSize;
+};
+
 
 // Internal definitions for a MySQL column definition
 class ADBColumn 
@@ -102,6 +291,16 @@ public:
     
     int                 define(uint columnNo, MYSQL_FIELD *mField, const char *newData = NULL);
 
+    // Points the column at data it doesn't own, such as a MYSQL_ROW
+    // buffer, without copying it.  The column makes its own copy the
+    // first time it is changed.
+    void                view(const char *rowData, ulong dataLen);
+
+    // Long values are kept in the arena, if one is set, instead of on
+    // the heap.  Its owner must clear the column's data before resetting
+    // the arena.
+    void                setArena(ADBArena *newArena);
+
     int                 set(const char *newData, int setBackupAlso = 0, int isEncrypted = 0, int useDefKey = 1);
     int                 set(int newValue);
     int                 set(long newValue);
@@ -119,13 +318,22 @@ public:
     void                setColumnNumber(uint newNum);
     void                setType(enum_field_types newType);
     void                setPrimaryKey(int newIsPrimary);
+    void                setServerSet(int newFlags);
 
     const char          *ColumnName();
     const char          *TableName();
+    ulong               Length();
     enum_field_types    DataType();
     uint                ColumnNo();
     int                 PrimaryKey();
+    int                 ServerSet();
+    // ColumnChanged() says whether the column has been assigned a value
+    // since it was loaded or cleared.  ValueChanged() also compares the
+    // value with the backup, which means looking at all of it.
     int                 ColumnChanged();
+    int                 ValueChanged();
+    void                setClean();
+    void                promote();
     const char          *Data(int useBackup = 0);
     
     // Data conversion functions.
@@ -133,6 +341,7 @@ public:
     long                toLong(int useBackup = 0);
     llong               toLLong(int useBackup = 0);
     float               toFloat(int useBackup = 0);
+    double              toDouble(int useBackup = 0);
     
     time_t              toTime_t(int useBackup = 0);
     
@@ -144,6 +353,8 @@ public:
     #endif
     
     const char          *insStr();
+    void                appendInsStr(ADBStmtBuf *sql);
+    const char          *storedData();
     
     int                 setEncrypted(int isEncrypted, int useDefKey = 1);
     int                 Encrypted();
@@ -151,8 +362,17 @@ public:
     void                setDebugLevel(int newDebugLevel);
 
 private:
-    void                decryptData(void);
+    void                decryptData(const char *srcData);
     void                encryptData(void);
+    void                releaseData(void);
+    void                resetStore(void);
+    char                *reserve(int slot, ulong size);
+    void                detach(void);
+    void                shiftToBackup(void);
+    void                swapStores(void);
+    void                syncText(int useBackup);
+    llong               nativeInt(int useBackup);
+    double              nativeDbl(int useBackup);
     
     char                intColumnName[ADB_MAXCOLWIDTH];
     char                intTableName[ADB_MAXCOLWIDTH];
@@ -160,15 +380,74 @@ private:
     int                 intColumnNo;
 
     int                 isPrimaryKey;
+    int                 intServerSet;
     int                 intIsEncrypted;
     int                 intUseDefKey;
 
     int                 debugLevel;
+    int                 typeWarnings;
     
     char                *intData;
     char                *intOldData;
+    int                 isView;
+    ulong               viewLen;
+    int                 isDirty;
+
+    // When a value is loaded the backup points at the data rather than
+    // holding a copy of it.  The first change ends the sharing.
+    int                 backupShared;
+
+    // The buffers behind intData (slot 0) and intOldData (slot 1).  Each
+    // is one of the inline buffers, a heap buffer or a piece of the arena,
+    // and is kept from one value to the next as long as it is big enough.
+    char                inlineBufs[2][ADB_COLINLINE];
+    char                *stores[2];
+    ulong               storeSizes[2];
+    int                 storeKinds[2];
+    ADBArena            *arena;
+
+    // Numbers are kept in their native form as well as, or instead of,
+    // as text.  The flags say which forms of the data and backup are
+    // current.  The text is only made when it's asked for.
+    int                 valFlags;
+    llong               valInt;
+    double              valDbl;
+    int                 oldFlags;
+    llong               oldInt;
+    double              oldDbl;
     
     char                *workStr;
+    ADBStmtBuf          insBuf;
+};
+
+
+/*
+** ADBColumnIndex - Maps column names to column numbers with a small open
+**                  addressing hash table, so looking up a column by name
+**                  doesn't mean comparing it against every column.  The
+**                  last few names looked up are also remembered by their
+**                  address, so the same string literal used again costs a
+**                  single compare.  The names are not copied and must
+**                  stay put while the index is in use.
+*/
+
+#define ADB_COLINDEX_SLOTS  (ADB_MAXCOLS * 2)
+#define ADB_COLINDEX_CACHE  16
+
+class ADBColumnIndex
+{
+public:
+    ADBColumnIndex();
+
+    void    clear();
+    void    add(const char *colName, uint colNo);
+    uint    find(const char *colName);
+
+private:
+    const char  *names[ADB_MAXCOLS];
+    short       slots[ADB_COLINDEX_SLOTS];
+    const char  *cacheNames[ADB_COLINDEX_CACHE];
+    uint        cacheCols[ADB_COLINDEX_CACHE];
 };
 
 
@@ -190,6 +469,12 @@ public:
     
     void    setDebugLevel(int newDebugLevel);
     void    setZeroDatesAsNULL(bool newValue);
+
+    // In zero copy mode the columns point straight into the MYSQL_ROW
+    // buffers and the column definitions are only set up once per result,
+    // so loading a row allocates nothing.  The data is only good until the
+    // next row is loaded, and the row is empty once loadRow() returns 0.
+    void    setZeroCopy(bool newValue);
     void    clearRow();
     int     loadRow(MYSQL_RES *queryRes);
     
@@ -210,6 +495,7 @@ public:
 protected:
     ADBColumn  *findColumn(unsigned int colNo);
     ADBColumn  *findColumn(const char *colName);
+    void        buildIndex();
     
 private:
     ADBColumn   *columns[ADB_MAXCOLS];
@@ -219,6 +505,321 @@ private:
     
     int         debugLevel;
     bool        zeroDatesAsNULL;
+    bool        zeroCopy;
+    MYSQL_RES   *rowRes;
+
+    ADBColumnIndex  colIndex;
+};
+
+
+/*
+** ADBResultSet - A query result held a column at a time instead of a row
+**                at a time.  Numbers are parsed once into arrays of llong
+**                or double, dates become epoch seconds in an llong array,
+**                and strings are packed end to end in one buffer.  Each
+**                column has a bitmap of its NULLs, and NULL numbers are
+**                stored as 0.
+**
+**                The aggregate functions run straight down the arrays.
+**                They can be limited to a selection, which is a bitmap
+**                with one bit per row.  Make one with selectionWords()
+**                words, set it with selectAll() and narrow it with
+**                filter().  Only non-NULL values are counted.
+*/
+
+struct ADBResultColumn;
+
+class ADBResultSet
+{
+public:
+    ADBResultSet();
+    ~ADBResultSet();
+
+    void            clear();
+    long            load(MYSQL_RES *res);
+
+    ulong           numRows();
+    uint            numColumns();
+    const char      *columnName(uint colNo);
+    uint            columnNumber(const char *colName);
+    int             columnKind(uint colNo);
+
+    // The raw columns.  ints() is for ADB_RS_INT and ADB_RS_TIME columns
+    // and doubles() for ADB_RS_DOUBLE columns.  Both return NULL for any
+    // other kind of column.
+    const llong     *ints(uint colNo);
+    const double    *doubles(uint colNo);
+    const ullong    *nulls(uint colNo);
+    const char      *str(uint colNo, ulong rowNo);
+    bool            isNull(uint colNo, ulong rowNo);
+
+    ulong           selectionWords();
+    void            selectAll(ullong *selection);
+    ulong           filter(uint colNo, int op, double value, ullong *selection);
+
+    ulong           count(uint colNo, const ullong *selection = NULL);
+    double          sum(uint colNo, const ullong *selection = NULL);
+    llong           sumInt(uint colNo, const ullong *selection = NULL);
+    double          min(uint colNo, const ullong *selection = NULL);
+    double          max(uint colNo, const ullong *selection = NULL);
+
+private:
+    ADBResultColumn *numericColumn(uint colNo, const char *caller);
+    void            grow(ulong minRows);
+    void            addString(ADBResultColumn *col, const char *src, ulong len);
+
+    ADBResultColumn *cols;
+    uint            numCols;
+    ulong           rows;
+    ulong           rowSize;
+    char            *strData;
+    ulong           strLen;
+    ulong           strSize;
+    ADBColumnIndex  colIndex;
+};
+
+
+/*
+** ADBRowSet - The rows ADBTable::getMany() loaded, in key order.  The rows
+**             are kept as the server sent them and only decoded into the
+**             table's columns by ADBTable::loadRow(), one at a time.
+*/
+
+class ADBRowSet
+{
+public:
+    ADBRowSet();
+    ~ADBRowSet();
+
+    void        clear();
+
+    ulong       count();
+    long        key(ulong rowNo);
+
+    // The row number of the row with the given key, or -1 if there isn't
+    // one.
+    long        find(long keyVal);
+
+    // The row as the server sent it, one string per column.
+    const char * const *row(ulong rowNo);
+
+private:
+    friend class ADBTable;
+    void        addResult(MYSQL_RES *res, uint keyColumn);
+
+    MYSQL_RES   **results;
+    uint        numResults;
+    uint        resultSpace;
+
+    MYSQL_ROW   *rows;
+    long        *keys;
+    ulong       numRows;
+    ulong       rowSpace;
+};
+
+
+/*
+** ADBPoolStats - The counters reported by ADBPool::getStats().
+*/
+
+struct ADBPoolStats
+{
+    ulong   hits;           // Requests handed an idle connection
+    ulong   misses;         // Requests that had to open a new connection
+    ulong   waits;          // Requests that waited because the pool was full
+    ullong  waitUSecs;      // Total time spent waiting, in microseconds
+    ulong   evictions;      // Idle connections closed by the idle timeout
+    ulong   pingFailures;   // Idle connections that failed mysql_ping()
+    ulong   idle;           // Connections currently sitting idle
+    ulong   inUse;          // Connections currently borrowed
+};
+
+/*
+** ADBPool - A process-wide pool of connections, keyed by host, user,
+**           password and database.  When enabled, ADB::ADB() borrows its
+**           connection from the pool and ADB::~ADB() gives it back.
+*/
+
+class ADBPool
+{
+public:
+    static  void    setEnabled(bool newVal);
+    static  bool    enabled();
+    static  void    setMaxSize(uint newMax);
+    static  void    setMinIdle(uint newMin);
+    static  void    setIdleTimeout(uint secs);
+    static  void    setValidateAfter(uint secs);
+    static  void    setWaitTimeout(uint msecs);
+
+    static  int     warmUp(
+                      uint count,
+                      const char *Name  = NULL,
+                      const char *User  = NULL,
+                      const char *Pass  = NULL,
+                      const char *Host  = NULL
+                    );
+    static  MYSQL  *acquire(const char *Host, const char *User, const char *Pass, const char *Name);
+    static  void    release(MYSQL *conn, bool reusable = true);
+    static  void    closeIdle();
+
+    static  void    getStats(ADBPoolStats *stats);
+    static  void    resetStats();
+};
+
+
+/*
+** ADBLog - An optional asynchronous sink for the log functions.  When it
+**          is running, log messages are queued on a ring and written to
+**          syslog/stderr by a background thread.
+*/
+
+class ADBLog
+{
+public:
+    static  int     start(uint slots = 4096, int overflowPolicy = ADB_LOG_DROP);
+    static  void    stop();
+    static  bool    running();
+    static  void    setOverflowPolicy(int newPolicy);
+
+    static  bool    push(int priority, const char *msg);
+    static  void    flush();
+    static  ulong   dropped();
+};
+
+
+/*
+** ADBSchemaColumn - A single column definition as held by ADBSchema.
+*/
+
+struct ADBSchemaColumn
+{
+    char                name[ADB_MAXCOLWIDTH];
+    enum_field_types    type;
+    int                 primaryKey;
+    int                 serverSet;      // ADB_SRVSET_* flags
+};
+
+/*
+** ADBSchema - A process-wide, thread safe cache of table definitions.
+**             ADBTable::setTableName() checks here before asking the
+**             server for the columns of a table.
+*/
+
+class ADBSchema
+{
+public:
+    static  void    setEnabled(bool newVal);
+    static  bool    enabled();
+
+    static  int     preload(
+                      const char *Name  = NULL,
+                      const char *User  = NULL,
+                      const char *Pass  = NULL,
+                      const char *Host  = NULL
+                    );
+    static  int     save(const char *fileName);
+    static  int     load(const char *fileName);
+
+    static  uint    lookup(const char *Host, const char *Name, const char *Table, ADBSchemaColumn *cols, uint maxCols);
+    static  void    store(const char *Host, const char *Name, const char *Table, const ADBSchemaColumn *cols, uint numCols);
+    static  void    invalidate(const char *Host, const char *Name, const char *Table);
+    static  void    clear();
+
+    static  enum_field_types parseType(const char *typeStr);
+    static  int     parseServerSet(const char *defaultStr, const char *extraStr);
+};
+
+
+/*
+** ADBRowCacheStats - The counters reported by ADBRowCache::getStats().
+*/
+
+struct ADBRowCacheStats
+{
+    ulong   hits;           // get() calls answered with a cached row
+    ulong   negativeHits;   // get() calls answered with a cached miss
+    ulong   misses;         // get() calls that had to ask the server
+    ulong   evictions;      // Rows dropped to stay within maxRows
+    ulong   expirations;    // Rows dropped because they were too old
+    ulong   invalidations;  // Rows dropped by ins(), upd() or del()
+    ulong   rows;           // Rows (and misses) currently cached
+};
+
+/*
+** ADBRowCache - An opt-in, process-wide cache of rows loaded by
+**               ADBTable::get(), kept per table and keyed by primary key.
+**               Each table holds at most maxRows rows, dropping the least
+**               recently used.  Rows older than ttlSecs are reloaded, and
+**               keys the server didn't have are remembered for negTtlSecs
+**               (0 turns that off).  ins(), upd(), del() and the batch
+**               inserts drop the rows they change, but changes made any
+**               other way, or by other processes, aren't seen until the
+**               row expires.
+*/
+
+class ADBRowCache
+{
+public:
+    static  int     enable(const char *Host, const char *Name, const char *Table, ulong maxRows, uint ttlSecs = 0, uint negTtlSecs = 0);
+    static  void    disable(const char *Host, const char *Name, const char *Table);
+    static  void    clear();
+
+    static  void    getStats(ADBRowCacheStats *stats);
+    static  int     getTableStats(const char *Host, const char *Name, const char *Table, ADBRowCacheStats *stats);
+    static  void    resetStats();
+
+    // Used by ADBTable.  fetch() returns 1 and points rowData into buf if
+    // the row is cached, -1 if the row is known not to exist and 0 if the
+    // server has to be asked.  What the server says is then passed to
+    // store() or storeMissing() with the generation fetch() gave back, so
+    // a row that was changed in the meantime isn't cached.
+    static  int     fetch(const char *Host, const char *Name, const char *Table, long keyVal, uint numCols, ADBStmtBuf *buf, const char **rowData, ullong *generation);
+    static  void    store(const char *Host, const char *Name, const char *Table, long keyVal, uint numCols, const char * const *rowData, ullong generation);
+    static  void    storeMissing(const char *Host, const char *Name, const char *Table, long keyVal, ullong generation);
+    static  void    invalidate(const char *Host, const char *Name, const char *Table, long keyVal);
+    static  void    invalidateRange(const char *Host, const char *Name, const char *Table, long firstKey, long lastKey);
+};
+
+
+/*
+** ADBStmtCache - The prepared statements that have been prepared on a
+**                single connection.  ADBTable uses these for get(), ins(),
+**                upd() and del() so the server doesn't have to reparse the
+**                statement each time.  Statements are kept with the
+**                connection so they survive being returned to the pool.
+*/
+
+// Statement kinds used as part of the cache key.
+#define ADB_STMT_GET    1
+#define ADB_STMT_INS    2
+#define ADB_STMT_UPD    3
+#define ADB_STMT_DEL    4
+
+struct ADBStmtEntry;
+
+class ADBStmtCache
+{
+public:
+    static  void            setEnabled(bool newVal);
+    static  bool            enabled();
+    static  ADBStmtCache    *forConnection(MYSQL *conn);
+    static  void            dropConnection(MYSQL *conn);
+
+    MYSQL_STMT  *find(const char *table, int kind, const ullong *colMask);
+    MYSQL_STMT  *prepare(const char *table, int kind, const ullong *colMask, const char *sql);
+    void        remove(MYSQL_STMT *stmt);
+    void        clear();
+
+protected:
+    ADBStmtCache(MYSQL *newConn);
+    ~ADBStmtCache();
+
+private:
+    MYSQL           *conn;
+    ADBStmtEntry    *entries;
+    uint            numEntries;
+    ulong           useCount;
+    ADBStmtCache    *next;
 };
 
 
@@ -250,7 +851,9 @@ public:
     static  void setDebugLevel(int newDebugLevel);
     static  void useSyslog(bool newVal);
     static  void recordUpdates(bool newVal);
+    static  bool recordingUpdates(void);
     static  void returnEmptyDatesAsNULL(bool newVal);
+    static  void useZeroCopyRows(bool newVal);
 
     int     Connected(void);
 
@@ -258,13 +861,59 @@ public:
     float   sumFloat(const char *format, ... );
     int     getrow(void);
     int     getfield(void);
+
+    // queryStream works like query, except that rows are pulled from the
+    // server one at a time by getrow() instead of being loaded into memory
+    // all at once.  rowCount holds the number of rows fetched so far and
+    // is only the full count once getrow() has returned 0.  Issuing any
+    // other query or command while a stream is open drains the rest of it.
+    int     queryStream(const char *format, ... );
+    int     streamOpen(void);
+    void    endStream(void);
     
+    // Converts column colNo of every row in the last query() into seconds
+    // since the epoch.  epochs must have room for rowCount values.  The
+    // row getrow() will return next is left alone.  Returns the number of
+    // values converted, or -1 if there is no stored result to convert.
+    long    getEpochs(uint colNo, llong *epochs);
+
+    // queryColumns performs a query and loads the whole result into an
+    // ADBResultSet rather than curRow.  The rows are read from the server
+    // as they are parsed, so the result is only held once.  rowCount is
+    // set to the number of rows loaded.  Returns 1 if the query worked.
+    int     queryColumns(ADBResultSet *resultSet, const char *format, ... );
+
     long    dbcmd(const char *format, ... );
+
+    // rawcmd sends a command of any length as is, without formatting it.
+    // It returns the insert id, or -1 if the command failed.
+    long    rawcmd(const char *cmd, ulong cmdLen);
     
     // Note that escapeString uses an internal buffer, so multiple calls
     // will trash the return pointer.
     const char  *escapeString(const char *src, int truncLen = 4096);
 
+    // Transactions cover the statements sent through this object's own
+    // connection only; every ADB and ADBTable has a connection of its own.
+    // begin() fails if a transaction is already open.  These return 1 on
+    // success and 0 on failure.  Savepoint names must be identifiers.
+    int     begin(void);
+    int     commit(void);
+    int     rollback(void);
+    int     inTransaction(void);
+    int     savepoint(const char *name);
+    int     rollbackTo(const char *name);
+    int     releaseSavepoint(const char *name);
+
+    // Batched commits.  Keeps a transaction open and commits it once it
+    // holds maxStatements statements or is maxMsecs old, whichever comes
+    // first, then starts the next one.  The limits are checked as each
+    // statement is sent.  commit() and rollback() end the current batch
+    // and start another; setCommitBatch(0, 0) commits it and turns
+    // batching off, as does deleting the object.  Passing 0 for one of
+    // the limits leaves it out.
+    int     setCommitBatch(ulong maxStatements, ulong maxMsecs = 0);
+
     ADBRow      curRow;
     ulong       rowCount;
     
@@ -272,6 +921,17 @@ protected:
     MYSQL       MyConn;
     MYSQL       *MySock;
     MYSQL_RES   *queryRes;
+    int         streaming;
+
+    void        drainStream(const char *caller);
+    void        recordUpdate(const char *cmd);
+
+    // Called after each commit or rollback with the number of statements
+    // the transaction held.  Subclasses use it to drop cached data.
+    virtual void transactionDone(int committed, ulong statements);
+    void        closeTransaction(void);
+
+    ADBStmtCache *statements();
     
     int         debugLevel;
 
@@ -282,11 +942,59 @@ protected:
     char        *DBName;
     
     char        *escWorkStr;
+    ulong       escWorkSize;
     
     int         connected;
+    bool        pooledConn;
+
+private:
+    ADBStmtCache *stmtCache;
+
+    friend class ADBTransaction;
+
+    int         txnOpen;
+    uint        txnScopes;          // ADBTransaction guards open on us
+    ulong       txnStatements;
+    llong       txnStarted;         // Milliseconds, monotonic clock
+    ulong       batchStatements;
+    ulong       batchMsecs;
+
+    int         startTransaction(void);
+    int         endTransaction(int doCommit);
+    int         savepointCmd(const char *verb, const char *name);
 };
 
 
+/*
+** ADBTransaction - Holds a transaction open on an ADB object for as long
+**                  as it is in scope.  Unless commit() is called, the work
+**                  is rolled back when it goes out of scope.  A guard made
+**                  while a transaction is already open uses a savepoint
+**                  instead, so guards nest, and batched commits are held
+**                  off until the last guard is done.
+*/
+
+class ADBTransaction
+{
+public:
+    ADBTransaction(ADB *db);
+    ~ADBTransaction();
+
+    int     commit(void);
+    int     rollback(void);
+    int     active(void);
+
+private:
+    ADB     *txnDB;
+    int     txnActive;
+    int     txnNested;
+    char    spName[32];
+};
+
+
+struct ADBTableStmt;
+struct ADBTableBatch;
+
 class ADBTable  : public ADB
 {
 
@@ -358,8 +1066,15 @@ public:
     // Row retrieval access
     long    get(long keyVal);
     int     get(int  keyVal);
+
+    // Limits the columns get() loads to the ones named (comma separated)
+    // and the primary key, or with excludeBlobs set, to the ones that
+    // aren't BLOB or TEXT.  The others are fetched with a query of their
+    // own the first time they are read.  setProjection(NULL) goes back to
+    // loading every column.  Returns the number of columns get() loads.
+    int     setProjection(const char *colNames, int excludeBlobs = 0);
     
-    // Row insert/update/delete members.
+    // Row insert/update/delete members.  autoGet is one of ADB_AUTOGET_*.
     long            ins(int autoGet = 1);
     virtual void    postIns(void)                   {};
     
@@ -368,6 +1083,42 @@ public:
 
     int             del(long keyVal = 0);
     virtual void    postDel(void)                   {};
+
+    // Multi-row versions of get() and del().  The keys are sorted and
+    // sent ADB_MANYKEYS_CHUNK at a time as "pk IN (...)".  getMany()
+    // returns the number of rows found and loadRow() decodes one of them
+    // into the columns, returning its key.  delMany() returns the number
+    // of rows deleted and doesn't call postDel().  If one of its
+    // statements fails it stops there, logs it, and returns the number
+    // the statements before it deleted.
+    long            getMany(const long *keyVals, ulong numKeys, ADBRowSet *rowSet);
+    long            loadRow(ADBRowSet *rowSet, ulong rowNo);
+    long            delMany(const long *keyVals, ulong numKeys);
+
+    // Batched inserts.  After batchBegin(), each batchAdd() queues the
+    // current column values as a row.  Rows are sent as multi-row inserts
+    // as large as the server's max_allowed_packet allows.  batchFlush()
+    // sends whatever is left and returns the number of rows inserted.  If
+    // the table has an auto increment key, firstKey and lastKey are set to
+    // the range of keys the rows were given.  postIns() is not called.
+    // Rows still queued when the object is deleted are flushed then.
+    //
+    // batchBegin(1) batches upserts instead: rows whose key (or another
+    // unique key) already exists have all their other columns updated.
+    // batchFlush() then returns the number of rows inserted and sets
+    // updated to the number that already existed.  The keys new rows
+    // were given aren't reported, since the server may skip some.
+    int             batchBegin(int upsert = 0);
+    int             batchAdd(void);
+    long            batchFlush(long *firstKey = NULL, long *lastKey = NULL, long *updated = NULL);
+
+    // Inserts the row, or if its key (or another unique key) already
+    // exists, updates the columns that have changed, in one statement.
+    // Returns the key of the row either way, and sets action to one of
+    // ADB_UPSERT_*.  autoGet works as it does for ins(), except that an
+    // existing row is always reloaded in full since only some of its
+    // columns were sent.
+    long            upsert(int autoGet = 1, int *action = NULL);
     
     // Misc functions.
     int             setEncryptedColumn(uint colNo, int useDefKey = 1);
@@ -381,8 +1132,106 @@ protected:
     uint        getColumnNumber(const char *colName);
     
     char        TableName[256];
+
+    ADBColumnIndex  colIndex;
+
+    // Loads a row into the columns, recycling the arena the column data
+    // is kept in.
+    void        loadColumns(const char * const *rowData);
+    ADBArena    colArena;
+
+    // Column projection.  projMask holds the columns get() loads and
+    // lazyMask the columns of the loaded row, key lazyKey, that it left
+    // out and haven't been read since.
+    int         projActive;
+    ullong      projMask[ADB_COLMASK_WORDS];
+    ullong      lazyMask[ADB_COLMASK_WORDS];
+    long        lazyKey;
+    long        getProjected(long keyVal);
+    void        loadLazy(const ullong *colMask);
+    void        loadAllLazy(void);
+
+    void        ensureLoaded(uint colNo);
+
+    // Clears the table's row cache after a commit, since other objects
+    // may have cached the old rows while ours were uncommitted.
+    virtual void transactionDone(int committed, ulong statements);
+
+private:
+    // Prepared statement versions of get/ins/upd/del.  They return -1
+    // if a statement couldn't be prepared and the text version should
+    // be used instead.
+    MYSQL_STMT  *preparedStmt(int kind, const ullong *colMask);
+    void        bindColumn(uint paramNo, uint colNo);
+    void        bindKey(uint paramNo, long keyVal);
+    long        stmtGet(long keyVal);
+    long        stmtIns(void);
+    long        stmtUpd(const ullong *colMask);
+    int         stmtDel(long keyVal);
+
+    ADBTableStmt *stmtData;
+
+    void        appendKeyList(const long *keyVals, ulong count);
+    void        appendUpsertClause(ADBStmtBuf *sql, int changedOnly);
+
+    // ADB_AUTOGET_MINIMAL support for ins() and upd().
+    long        settleIns(long insertId);
+    int         refetchServerSet(int flags, long keyVal);
+
+    int         batchSend(void);
+
+    ADBTableBatch *batchData;
+
+    // The buffer the text versions of ins() and upd() build their
+    // statements in.
+    ADBStmtBuf  sqlBuf;
+
+    // Where get() copies rows out of the ADBRowCache, and the cache
+    // generation it saw before asking the server.
+    ADBStmtBuf  cacheBuf;
+    ullong      cacheGen;
+};
+
+
+/*
+** ADBRangeResult - What happened to one key range of a parallel walk.
+*/
+
+struct ADBRangeResult
+{
+    uint    rangeNo;
+    long    firstKey;
+    long    lastKey;
+    long    rows;
+    long    errors;
+    long    firstErrorKey;
+    int     failed;
+};
+
+/*
+** ADBParallelStats - The totals for a parallel walk.
+*/
+
+struct ADBParallelStats
+{
+    uint    ranges;
+    uint    failedRanges;
+    long    rows;
+    long    errors;
+    long    firstErrorKey;
 };
 
+class ADBList;
+
+// Called by ADBList::forEachParallel for each row, on a worker thread.
+// list is the worker's own list, with the row loaded.  Returning anything
+// but 0 counts the row as an error.
+typedef int  (*ADBRowFunc)(ADBList *list, long keyVal, void *userData);
+
+// Called by ADBList::forEachParallel on the calling thread as each range
+// is finished.
+typedef void (*ADBRangeFunc)(const ADBRangeResult *range, void *userData);
+
 
 // ADBList simulates a doubly linked list for accessing the columns from 
 // a single table returned by a query.  It provides a convenient method 
@@ -429,10 +1278,63 @@ public:
     long    prev(void);
     long    next(void);
 
+    // With prefetching turned on, traversal loads the rows for the next
+    // windowSize keys with a single query instead of one get() per row,
+    // so a list no larger than the window is loaded in one pass.  Rows
+    // are as they were when their window was loaded.  0 turns it off.
+    void    setPrefetch(long windowSize);
+
+    // streamList is an alternative to getList for very large tables.  It
+    // walks the matching rows in primary key order a page at a time
+    // (WHERE condition AND pk > last ORDER BY pk LIMIT pageSize), so
+    // memory use stays constant and the first row is loaded right away.
+    // The condition is given without the "where", and can't contain an
+    // order by or limit.  Only first() and next() work on a streamed list.
+    // Returns the key of the first row, or 0 if there were none.
+    long    streamList(const char *condition = NULL, long pageSize = 1000);
+
+    // forEachParallel splits the primary key space of the rows matching
+    // condition into ranges and walks them on up to numThreads threads,
+    // each with its own connection and list, calling rowFunc for every
+    // row.  Encrypted column settings are copied to the workers.  If
+    // rangeFunc is given it is called on this thread as each range
+    // finishes, in range order if ordered is set.  Returns the number of
+    // rows walked; stats, if given, gets the totals and error counts.
+    long    forEachParallel(
+              const char *condition,
+              uint numThreads,
+              ADBRowFunc rowFunc,
+              void *userData = NULL,
+              ADBRangeFunc rangeFunc = NULL,
+              bool ordered = false,
+              ADBParallelStats *stats = NULL
+            );
+
 private:
+    static void *parallelWorker(void *jobPtr);
+
+    long    loadKey(long keyNo);
+    int     loadPage(int firstPage);
+    long    nextInPage(void);
+    void    endKeyset(void);
+    int     loadWindow(long keyNo);
+    void    freeWindow(void);
+
     long    *keyList;
     long    totKeys;
     long    curKeyNo;
+
+    long        prefetchSize;
+    MYSQL_RES   *winRes;
+    MYSQL_ROW   *winRows;
+    long        winStart;
+    long        winEnd;
+
+    int         keysetMode;
+    char        *keysetCond;
+    long        keysetPage;
+    long        keysetLast;
+    long        keysetRows;
 };
 
 
@@ -0,0 +1,119 @@
+/**
+ * ADBArena.cpp - A bump allocator that ADBTable keeps its column data in.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <ADB.h>
+
+
+// The header of each block.  The memory handed out follows it.
+struct ADBArenaBlock
+{
+    ADBArenaBlock   *next;
+    ulong           size;
+    ulong           used;
+};
+
+/*
+** ADBArena::ADBArena - Creates an empty arena.  No memory is allocated
+**                      until something is asked for.
+*/
+
+ADBArena::ADBArena()
+{
+    blocks    = NULL;
+    curBlock  = NULL;
+    totalSize = 0;
+}
+
+/*
+** ADBArena::~ADBArena - Frees all of the blocks.
+*/
+
+ADBArena::~ADBArena()
+{
+    while (blocks) {
+        ADBArenaBlock *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+}
+
+/*
+** ADBArena::alloc - Returns size bytes from the arena, adding a block if
+**                   none of the ones we have can hold it.  Returns NULL if
+**                   that would take the arena past ADB_ARENA_MAX, in which
+**                   case the caller should use the heap.
+*/
+
+void *ADBArena::alloc(ulong size)
+{
+    size = (size + 7) & ~7UL;
+
+    // After a reset the blocks are reused in order.  One that can't hold
+    // this request is skipped for the rest of the round.
+    while (curBlock && curBlock->used + size > curBlock->size && curBlock->next) {
+        curBlock = curBlock->next;
+    }
+
+    if (!curBlock || curBlock->used + size > curBlock->size) {
+        ulong blockSize = size > ADB_ARENA_BLOCK ? size : ADB_ARENA_BLOCK;
+        if (totalSize + blockSize > ADB_ARENA_MAX) return NULL;
+
+        ADBArenaBlock *newBlock = (ADBArenaBlock *) malloc(sizeof(ADBArenaBlock) + blockSize);
+        if (!newBlock) return NULL;
+        newBlock->next = NULL;
+        newBlock->size = blockSize;
+        newBlock->used = 0;
+        if (curBlock) curBlock->next = newBlock;
+        else blocks = newBlock;
+        curBlock   = newBlock;
+        totalSize += blockSize;
+    }
+
+    void *retVal = (char *) (curBlock + 1) + curBlock->used;
+    curBlock->used += size;
+    return retVal;
+}
+
+/*
+** ADBArena::reset - Gives back everything allocated from the arena.  The
+**                   blocks are kept for reuse.
+*/
+
+void ADBArena::reset()
+{
+    for (ADBArenaBlock *blk = blocks; blk; blk = blk->next) blk->used = 0;
+    curBlock = blocks;
+}
+
+/*
+** ADBArena::size - Returns the total size of the blocks the arena holds.
+*/
+
+ulong ADBArena::size()
+{
+    return totalSize;
+}
@@ -39,6 +39,175 @@
 #include <qstring.h>
 #endif
 
+// Where the buffer behind a column's data or backup came from.
+#define ADB_STORE_INLINE    0
+#define ADB_STORE_HEAP      1
+#define ADB_STORE_ARENA     2
+
+
+/*
+** ADBFormatLLong - Writes a long long as decimal text into buf, which must
+**                  hold at least 21 characters.  Returns the length.
+*/
+
+int ADBFormatLLong(char *buf, llong val)
+{
+    char    tmp[24];
+    int     len = 0;
+    ullong  uval = val < 0 ? 0 - (ullong) val : (ullong) val;
+    do {
+        tmp[len++] = '0' + (char) (uval % 10);
+        uval /= 10;
+    } while (uval);
+
+    char    *pos = buf;
+    if (val < 0) *pos++ = '-';
+    while (len) *pos++ = tmp[--len];
+    *pos = '\0';
+    return pos - buf;
+}
+
+// The number of hours whose UTC offset each thread remembers.
+#define ADB_TZCACHE_SIZE    256
+
+struct ADBTzCacheEntry
+{
+    llong   hour;
+    long    offset;
+    int     valid;
+    int     steady;
+};
+
+static __thread ADBTzCacheEntry ADBTzCache[ADB_TZCACHE_SIZE];
+
+/*
+** ADBDaysFromCivil - Returns the number of days from 1970-01-01 to a date
+**                    in the proleptic Gregorian calendar.
+*/
+
+static inline llong ADBDaysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    llong   era = (year >= 0 ? year : year - 399) / 400;
+    uint    yoe = (uint) (year - era * 400);
+    uint    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (llong) doe - 719468;
+}
+
+/*
+** ADBMkTime - Converts local time fields with mktime(), letting it work
+**             out whether daylight saving time applies.
+*/
+
+static llong ADBMkTime(int year, int month, int day, int hour, int min, int sec)
+{
+    tm      t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year  = year - 1900;
+    t.tm_mon   = month - 1;
+    t.tm_mday  = day;
+    t.tm_hour  = hour;
+    t.tm_min   = min;
+    t.tm_sec   = sec;
+    t.tm_isdst = -1;
+    return (llong) mktime(&t);
+}
+
+/*
+** ADBLocalOffset - Gets what has to be added to a local time, counted as
+**                  if it were UTC, to get the real time.  mktime() is only
+**                  asked once per hour, and the answer kept in a small
+**                  per-thread cache.  Returns 0 if the offset changes
+**                  during the hour, in which case the caller should ask
+**                  mktime() about the time itself.
+*/
+
+static int ADBLocalOffset(llong asUTC, long *offset)
+{
+    llong   hour = asUTC >= 0 ? asUTC / 3600 : -((-asUTC + 3599) / 3600);
+    ADBTzCacheEntry *entry = &ADBTzCache[(ullong) hour & (ADB_TZCACHE_SIZE - 1)];
+    if (!entry->valid || entry->hour != hour) {
+        time_t  hourStart = (time_t) (hour * 3600);
+        tm      t;
+        gmtime_r(&hourStart, &t);
+        int     year = t.tm_year + 1900;
+        llong   first = ADBMkTime(year, t.tm_mon + 1, t.tm_mday, t.tm_hour, 0, 0);
+        llong   last  = ADBMkTime(year, t.tm_mon + 1, t.tm_mday, t.tm_hour, 59, 59);
+        entry->offset = (long) (first - hour * 3600);
+        entry->steady = last - first == 3599;
+        entry->hour   = hour;
+        entry->valid  = 1;
+    }
+    *offset = entry->offset;
+    return entry->steady;
+}
+
+/*
+** ADBDigits - Converts count digits to a number.  bad is set if any of
+**             them aren't digits.
+*/
+
+static inline int ADBDigits(const char *src, int count, uint *bad)
+{
+    int     retVal = 0;
+    for (int i = 0; i < count; i++) {
+        uint digit = (uint) (unsigned char) src[i] - '0';
+        *bad   |= digit > 9;
+        retVal  = retVal * 10 + (int) digit;
+    }
+    return retVal;
+}
+
+/*
+** ADBDateTimeToEpoch - Converts a MySQL DATETIME or TIMESTAMP in local
+**                      time, either "YYYY-MM-DD HH:MM:SS" or
+**                      "YYYYMMDDHHMMSS", to seconds since the epoch.  A
+**                      DATE on its own is taken as midnight.  Fractional
+**                      seconds are ignored.  Zero dates, and anything we
+**                      can't parse, come back as 0.
+*/
+
+llong ADBDateTimeToEpoch(const char *src, ulong len)
+{
+    int     year, month, day, hour = 0, min = 0, sec = 0;
+    uint    bad = 0;
+
+    if (!src) return 0;
+    if (len == 14) {
+        year  = ADBDigits(src,      4, &bad);
+        month = ADBDigits(src +  4, 2, &bad);
+        day   = ADBDigits(src +  6, 2, &bad);
+        hour  = ADBDigits(src +  8, 2, &bad);
+        min   = ADBDigits(src + 10, 2, &bad);
+        sec   = ADBDigits(src + 12, 2, &bad);
+    } else if (len >= 10 && src[4] == '-' && src[7] == '-') {
+        year  = ADBDigits(src,     4, &bad);
+        month = ADBDigits(src + 5, 2, &bad);
+        day   = ADBDigits(src + 8, 2, &bad);
+        if (len >= 19) {
+            if (src[13] != ':' || src[16] != ':') return 0;
+            hour = ADBDigits(src + 11, 2, &bad);
+            min  = ADBDigits(src + 14, 2, &bad);
+            sec  = ADBDigits(src + 17, 2, &bad);
+        } else if (len != 10) {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+    if (bad || !(year | month | day)) return 0;
+
+    // mktime() copes with out of range fields, so leave those to it.
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60) {
+        return ADBMkTime(year, month, day, hour, min, sec);
+    }
+
+    llong   asUTC = ADBDaysFromCivil(year, month, day) * 86400 + hour * 3600 + min * 60 + sec;
+    long    offset;
+    if (!ADBLocalOffset(asUTC, &offset)) return ADBMkTime(year, month, day, hour, min, sec);
+    return asUTC + offset;
+}
 
 /*
 ** ADBColumn::ADBColumn  - The constructor for a query row.
@@ -47,15 +216,34 @@
 ADBColumn::ADBColumn()
 {
     // We have not yet defined our column information, so set everything
-    // to blank.
-    intData     = (char *) calloc(16, sizeof(char));
-    intOldData  = (char *) calloc(16, sizeof(char));
-    workStr     = (char *) calloc(16, sizeof(char));
+    // to blank.  Until something longer comes along, the data and backup
+    // live in the inline buffers.
+    intData     = NULL;
+    intOldData  = NULL;
+    for (int slot = 0; slot < 2; slot++) {
+        stores[slot]     = NULL;
+        storeSizes[slot] = 0;
+        storeKinds[slot] = ADB_STORE_INLINE;
+    }
+    arena       = NULL;
+    isView      = 0;
+    isDirty     = 0;
+    backupShared = 0;
+    viewLen     = 0;
+    valFlags    = ADB_VAL_TEXT;
+    valInt      = 0;
+    valDbl      = 0.0;
+    oldFlags    = ADB_VAL_TEXT;
+    oldInt      = 0;
+    oldDbl      = 0.0;
+    workStr     = NULL;
     clear();
     
     debugLevel     = 0;
+    typeWarnings   = 0;
     intIsEncrypted = 0;
     isPrimaryKey   = 0;
+    intServerSet   = 0;
 }
 
 /*
@@ -67,8 +255,7 @@ ADBColumn::~ADBColumn()
 {
     ADBDebugMsg(7, "ADBColumn: Freeing column number %d, defined as '%s'", intColumnNo, intColumnName);
     clear();
-    free(intData);
-    free(intOldData);
+    releaseData();
     free(workStr);
 }
 
@@ -85,6 +272,7 @@ void ADBColumn::clear()
     intDataType      = FIELD_TYPE_NULL;
     intColumnNo      = -1;
     isPrimaryKey     = 0;
+    intServerSet     = 0;
     intIsEncrypted   = 0;
     intUseDefKey     = 1;
 }
@@ -95,10 +283,17 @@ void ADBColumn::clear()
 
 void ADBColumn::clearData()
 {
-    free(intData);
-    free(intOldData);
-    intData          = (char *) calloc(16, sizeof(char));
-    intOldData       = (char *) calloc(16, sizeof(char));
+    resetStore();
+}
+
+/*
+** ADBColumn::setArena - Gives the column an arena to keep long values in.
+*/
+
+void ADBColumn::setArena(ADBArena *newArena)
+{
+    resetStore();
+    arena = newArena;
 }
 
 /*
@@ -122,6 +317,8 @@ int ADBColumn::define(uint columnNo, MYSQL_FIELD *mField, const char *newData)
     
     if (mField) {
         ADBDebugMsg(7, "ADBColumn::define() clearing currently loaded data for column %d...", columnNo);
+        // A different column gets its own type warnings.
+        if (intDataType != mField->type || strcmp(intColumnName, mField->name)) typeWarnings = 0;
         clear();
 
         // Now, fill in the column name, its type, etc.
@@ -132,16 +329,11 @@ int ADBColumn::define(uint columnNo, MYSQL_FIELD *mField, const char *newData)
         intColumnNo     = columnNo;
         isPrimaryKey    = IS_PRI_KEY(mField->flags);
         
-        free(intData);
-        free(intOldData);
         if (newData) {
-            intData = (char *) calloc(strlen(newData)+16, sizeof(char));
-            intOldData = (char *) calloc(strlen(newData)+16, sizeof(char));
-            strcpy(intData, newData);
-            strcpy(intOldData, newData);
-        } else {
-            intData = (char *) calloc(16, sizeof(char));
-            intOldData = (char *) calloc(16, sizeof(char));
+            ulong newDataLen = strlen(newData) + 1;
+            memcpy(reserve(0, newDataLen), newData, newDataLen);
+            intOldData   = intData;
+            backupShared = 1;
         }
 
         ret = 1;
@@ -157,25 +349,28 @@ int ADBColumn::define(uint columnNo, MYSQL_FIELD *mField, const char *newData)
 int ADBColumn::set(const char *newData, int setBackupAlso, int isEncrypted, int useDefKey)
 {
     int     ret = 1;
-    int     newDataLen = 16;
+    if (!newData) newData = "";
+    ulong   newDataLen = strlen(newData) + 1;
     intUseDefKey = useDefKey;
-    free(intOldData);
-    intOldData = intData;
-    if (newData) newDataLen += strlen(newData);
-    intData = (char *) calloc(newDataLen, sizeof(char));
-    if (newData) strcpy(intData, newData);
+    shiftToBackup();
+    valFlags = ADB_VAL_TEXT;
     
-    // Was the data passed into us encrypted?  If so, decrypt it before
-    // we copy to the backup data.
+    // Was the data passed into us encrypted?  If so, decrypt it on the
+    // way in.
     if (isEncrypted) {
-        decryptData();
+        decryptData(newData);
+    } else {
+        memcpy(reserve(0, newDataLen), newData, newDataLen);
     }
     
-    // Did the caller request that we set the backup data as well?
+    // Did the caller request that we set the backup data as well?  The
+    // backup shares the data until the data is changed.  This is a load,
+    // not a change, so the column is clean afterwards.
     if (setBackupAlso) {
-        free(intOldData);
-        intOldData = (char *) calloc(newDataLen, sizeof(char));
-        if (newData) strcpy(intOldData, newData);
+        intOldData   = intData;
+        backupShared = 1;
+        oldFlags     = ADB_VAL_TEXT;
+        isDirty      = 0;
     }
     
     return ret;
@@ -188,10 +383,9 @@ int ADBColumn::set(const char *newData, int setBackupAlso, int isEncrypted, int
 int ADBColumn::set(int newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(32, sizeof(char));
-    sprintf(intData, "%d", newValue);
+    shiftToBackup();
+    valFlags = ADB_VAL_INT;
+    valInt   = newValue;
     return ret;
 }
 
@@ -202,10 +396,9 @@ int ADBColumn::set(int newValue)
 int ADBColumn::set(long newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
-    sprintf(intData, "%ld", newValue);
+    shiftToBackup();
+    valFlags = ADB_VAL_INT;
+    valInt   = newValue;
     return ret;
 }
 
@@ -216,10 +409,9 @@ int ADBColumn::set(long newValue)
 int ADBColumn::set(llong newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
-    sprintf(intData, "%qd", newValue);
+    shiftToBackup();
+    valFlags = ADB_VAL_INT;
+    valInt   = newValue;
     return ret;
 }
 
@@ -230,10 +422,9 @@ int ADBColumn::set(llong newValue)
 int ADBColumn::set(float newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
-    sprintf(intData, "%f", newValue);
+    shiftToBackup();
+    valFlags = ADB_VAL_DBL;
+    valDbl   = newValue;
     return ret;
 }
 
@@ -244,10 +435,9 @@ int ADBColumn::set(float newValue)
 int ADBColumn::set(double newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
-    sprintf(intData, "%f", newValue);
+    shiftToBackup();
+    valFlags = ADB_VAL_DBL;
+    valDbl   = newValue;
     return ret;
 }
 
@@ -258,11 +448,14 @@ int ADBColumn::set(double newValue)
 int ADBColumn::append(const char *appVal)
 {
     int     ret = 1;
-    if (intOldData) free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(strlen(intOldData)+strlen(appVal)+64, sizeof(char));
-    if (intOldData) strcpy(intData, intOldData);
-    strcat(intData, appVal);
+    shiftToBackup();
+    syncText(1);
+    ulong   oldLen = strlen(intOldData);
+    ulong   appLen = strlen(appVal);
+    char    *buf   = reserve(0, oldLen + appLen + 1);
+    memcpy(buf, intOldData, oldLen);
+    memcpy(buf + oldLen, appVal, appLen + 1);
+    valFlags = ADB_VAL_TEXT;
     return ret;
 }
 
@@ -275,9 +468,9 @@ int ADBColumn::append(const char *appVal)
 int ADBColumn::set(const QDate newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
+    shiftToBackup();
+    reserve(0, 64);
+    valFlags = ADB_VAL_TEXT;
     sprintf(intData, "%04d-%02d-%02d", newValue.year(), newValue.month(), newValue.day());
     return ret;
 }
@@ -289,9 +482,9 @@ int ADBColumn::set(const QDate newValue)
 int ADBColumn::set(const QTime newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
+    shiftToBackup();
+    reserve(0, 64);
+    valFlags = ADB_VAL_TEXT;
     sprintf(intData, "%02d:%02d:%02d", newValue.hour(), newValue.minute(), newValue.second());
     return ret;
 }
@@ -303,9 +496,9 @@ int ADBColumn::set(const QTime newValue)
 int ADBColumn::set(const QDateTime newValue)
 {
     int     ret = 1;
-    free(intOldData);
-    intOldData = intData;
-    intData = (char *) calloc(64, sizeof(char));
+    shiftToBackup();
+    reserve(0, 64);
+    valFlags = ADB_VAL_TEXT;
     sprintf(intData, "%04d%02d%02d%02d%02d%02d", 
       newValue.date().year(), newValue.date().month(), newValue.date().day(),
       newValue.time().hour(), newValue.time().minute(), newValue.time().second());
@@ -315,6 +508,225 @@ int ADBColumn::set(const QDateTime newValue)
 #endif  // ADBQT
 
 
+/*
+** view   - Points the column at data owned by someone else, usually a
+**          MYSQL_ROW.  Both the data and the backup point at it, and
+**          nothing is copied until the column is changed.
+*/
+
+void ADBColumn::view(const char *rowData, ulong dataLen)
+{
+    resetStore();
+    intData    = (char *) (rowData ? rowData : "");
+    intOldData = intData;
+    viewLen    = rowData ? dataLen : 0;
+    isView     = 1;
+}
+
+/*
+** detach - Gives a column that is viewing someone else's data its own
+**          copy of it, so that it can be changed.
+*/
+
+void ADBColumn::detach(void)
+{
+    if (!isView) return;
+    const char *src = intData;
+    isView     = 0;
+    char *dst  = reserve(0, viewLen + 1);
+    memcpy(dst, src, viewLen);
+    dst[viewLen] = '\0';
+    intOldData   = intData;
+    backupShared = 1;
+}
+
+/*
+** releaseData - Frees any heap buffers the data and backup are in.
+*/
+
+void ADBColumn::releaseData(void)
+{
+    for (int slot = 0; slot < 2; slot++) {
+        if (storeKinds[slot] == ADB_STORE_HEAP) free(stores[slot]);
+        stores[slot]     = NULL;
+        storeSizes[slot] = 0;
+        storeKinds[slot] = ADB_STORE_INLINE;
+    }
+    isView     = 0;
+    backupShared = 0;
+    intData    = NULL;
+    intOldData = NULL;
+    valFlags   = ADB_VAL_TEXT;
+    oldFlags   = ADB_VAL_TEXT;
+}
+
+/*
+** resetStore - Empties the data and backup.  Heap buffers that aren't
+**              too big are kept for the next value.  Arena buffers are
+**              given up, since the arena may be reset after this, and
+**              the inline buffers are used in their place.
+*/
+
+void ADBColumn::resetStore(void)
+{
+    isView       = 0;
+    isDirty      = 0;
+    backupShared = 0;
+    for (int slot = 0; slot < 2; slot++) {
+        if (storeKinds[slot] == ADB_STORE_ARENA ||
+            (storeKinds[slot] == ADB_STORE_HEAP && storeSizes[slot] > ADB_COLHEAPKEEP)) {
+            if (storeKinds[slot] == ADB_STORE_HEAP) free(stores[slot]);
+            stores[slot] = NULL;
+        }
+    }
+
+    // Hand out the inline buffers, skipping one the other slot still has.
+    for (int slot = 0; slot < 2; slot++) {
+        if (stores[slot]) continue;
+        stores[slot]     = inlineBufs[stores[1 - slot] == inlineBufs[0] ? 1 : 0];
+        storeSizes[slot] = ADB_COLINLINE;
+        storeKinds[slot] = ADB_STORE_INLINE;
+    }
+
+    stores[0][0] = '\0';
+    stores[1][0] = '\0';
+    intData    = stores[0];
+    intOldData = stores[1];
+    valFlags   = ADB_VAL_TEXT;
+    oldFlags   = ADB_VAL_TEXT;
+}
+
+/*
+** reserve - Returns the buffer for the data (slot 0) or backup (slot 1),
+**           making sure it holds at least size bytes.  A buffer that is
+**           already big enough is reused.  Otherwise the new one comes
+**           from the arena if we have one, and from the heap if not.
+**           The old contents are not kept.
+*/
+
+char *ADBColumn::reserve(int slot, ulong size)
+{
+    // Writing to either buffer ends the sharing.  If it's the data that
+    // is about to change, the shared value moves over to be the backup.
+    if (backupShared) {
+        backupShared = 0;
+        if (!slot) swapStores();
+    }
+
+    if (size > storeSizes[slot]) {
+        char *newBuf = arena ? (char *) arena->alloc(size) : NULL;
+        if (newBuf) {
+            if (storeKinds[slot] == ADB_STORE_HEAP) free(stores[slot]);
+            storeSizes[slot] = size;
+            storeKinds[slot] = ADB_STORE_ARENA;
+        } else {
+            ulong newSize = (size + 63) & ~63UL;
+            if (storeKinds[slot] == ADB_STORE_HEAP) free(stores[slot]);
+            newBuf = (char *) malloc(newSize);
+            storeSizes[slot] = newSize;
+            storeKinds[slot] = ADB_STORE_HEAP;
+        }
+        stores[slot] = newBuf;
+    }
+
+    if (slot) intOldData = stores[1];
+    else intData = stores[0];
+    return stores[slot];
+}
+
+/*
+** swapStores - Swaps the data and backup buffers.
+*/
+
+void ADBColumn::swapStores(void)
+{
+    char  *tmpStore = stores[0];
+    ulong tmpSize   = storeSizes[0];
+    int   tmpKind   = storeKinds[0];
+    stores[0]     = stores[1];
+    storeSizes[0] = storeSizes[1];
+    storeKinds[0] = storeKinds[1];
+    stores[1]     = tmpStore;
+    storeSizes[1] = tmpSize;
+    storeKinds[1] = tmpKind;
+    intData       = stores[0];
+    intOldData    = stores[1];
+}
+
+/*
+** shiftToBackup - Makes the current value the backup before a new value
+**                 is set, and marks the column as changed.  The old
+**                 backup's buffer is left in intData for the caller to
+**                 reuse.
+*/
+
+void ADBColumn::shiftToBackup(void)
+{
+    detach();
+    backupShared = 0;
+    swapStores();
+    isDirty      = 1;
+
+    oldFlags   = valFlags;
+    oldInt     = valInt;
+    oldDbl     = valDbl;
+}
+
+/*
+** syncText - Makes sure the text form of the data (or backup) is current,
+**            formatting the native value if it isn't.
+*/
+
+void ADBColumn::syncText(int useBackup)
+{
+    int     *flags = useBackup ? &oldFlags : &valFlags;
+    if (*flags & ADB_VAL_TEXT) return;
+
+    if (*flags & ADB_VAL_INT) {
+        ADBFormatLLong(reserve(useBackup, 24), useBackup ? oldInt : valInt);
+    } else {
+        double  val = useBackup ? oldDbl : valDbl;
+        int     len = snprintf(NULL, 0, "%f", val);
+        snprintf(reserve(useBackup, len + 1), len + 1, "%f", val);
+    }
+    *flags |= ADB_VAL_TEXT;
+}
+
+/*
+** nativeInt - Returns the data (or backup) as a long long, parsing the
+**             text only if we don't already have it as a number.
+*/
+
+llong ADBColumn::nativeInt(int useBackup)
+{
+    int     *flags = useBackup ? &oldFlags : &valFlags;
+    llong   *val   = useBackup ? &oldInt : &valInt;
+    if (*flags & ADB_VAL_INT) return *val;
+    if (!(*flags & ADB_VAL_TEXT)) return (llong) (useBackup ? oldDbl : valDbl);
+
+    *val = atoll(useBackup ? intOldData : intData);
+    *flags |= ADB_VAL_INT;
+    return *val;
+}
+
+/*
+** nativeDbl - Returns the data (or backup) as a double, parsing the text
+**             only if we don't already have it as a number.
+*/
+
+double ADBColumn::nativeDbl(int useBackup)
+{
+    int     *flags = useBackup ? &oldFlags : &valFlags;
+    double  *val   = useBackup ? &oldDbl : &valDbl;
+    if (*flags & ADB_VAL_DBL) return *val;
+    if (!(*flags & ADB_VAL_TEXT)) return (double) (useBackup ? oldInt : valInt);
+
+    const char *src = useBackup ? intOldData : intData;
+    *val = ADBStrToDouble(src, strlen(src));
+    *flags |= ADB_VAL_DBL;
+    return *val;
+}
+
 /*
 ** setColumnName  - Allows us to set the name of the column manually.
 */
@@ -359,6 +771,16 @@ void ADBColumn::setPrimaryKey(int newIsPrimary)
     isPrimaryKey = newIsPrimary;
 }
 
+/*
+** setServerSet - Sets the ADB_SRVSET_* flags saying when the server may
+**                store something other than what we sent it.
+*/
+
+void ADBColumn::setServerSet(int newFlags)
+{
+    intServerSet = newFlags;
+}
+
 
 
 /*
@@ -407,14 +829,80 @@ int ADBColumn::PrimaryKey()
 }
 
 /*
-** ColumnChanged  - Tells the caller if Data == intOldData.
+** ServerSet - Returns the ADB_SRVSET_* flags for the column.
+*/
+
+int ADBColumn::ServerSet()
+{
+    return intServerSet;
+}
+
+/*
+** ColumnChanged  - Tells the caller if the column has been assigned a
+**                  value since it was loaded or cleared.
 */
 
 int ADBColumn::ColumnChanged()
 {
+    return isDirty;
+}
+
+/*
+** setClean - Marks the column as unchanged, i.e. once it has been saved.
+*/
+
+void ADBColumn::setClean()
+{
+    isDirty = 0;
+}
+
+/*
+** promote - Makes the current value the backup as well and marks the
+**           column clean, as if it had just been loaded.  Used once a
+**           value has been saved and we know the server has it.
+*/
+
+void ADBColumn::promote()
+{
+    detach();
+    intOldData   = intData;
+    backupShared = 1;
+    oldFlags     = valFlags;
+    oldInt       = valInt;
+    oldDbl       = valDbl;
+    isDirty      = 0;
+}
+
+/*
+** ValueChanged - Tells the caller if the data is different from the
+**                backup.  Unlike ColumnChanged() this compares them.
+*/
+
+int ADBColumn::ValueChanged()
+{
+    if (!isDirty) return 0;
+
+    // Two numbers that were never text can be compared as numbers.
+    if (!(valFlags & ADB_VAL_TEXT) && !(oldFlags & ADB_VAL_TEXT)) {
+        if ((valFlags & ADB_VAL_INT) && (oldFlags & ADB_VAL_INT)) return valInt != oldInt;
+        if ((valFlags & ADB_VAL_DBL) && (oldFlags & ADB_VAL_DBL)) return valDbl != oldDbl;
+    }
+    syncText(0);
+    syncText(1);
     return strcmp(intData, intOldData);
 }
 
+/*
+** Length - Returns the length of the data.
+*/
+
+ulong ADBColumn::Length()
+{
+    if (isView) return viewLen;
+    syncText(0);
+    return strlen(intData);
+}
+
 /*
 ** Data - Returns a reference to the data.
 **        This is probably dangerous.
@@ -422,6 +910,7 @@ int ADBColumn::ColumnChanged()
 
 const char *ADBColumn::Data(int useBackup)
 {
+    syncText(useBackup);
     if (useBackup) return intOldData;
     else return intData;
 }
@@ -463,10 +952,14 @@ int ADBColumn::toInt(int useBackup)
     if (intDataType != FIELD_TYPE_TINY &&
         intDataType != FIELD_TYPE_SHORT &&
         intDataType != FIELD_TYPE_LONG
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toInt(%d:%s) - Warning! Column is not an integer (type = %d)", intColumnNo, intColumnName, intDataType);
+       ) {
+        if (!(typeWarnings & ADB_WARN_INT)) {
+            typeWarnings |= ADB_WARN_INT;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toInt(%d:%s) - Warning! Column is not an integer (type = %d)", intColumnNo, intColumnName, intDataType);
+        }
+    }
 
-    if (useBackup) return atoi(intOldData);
-    else return atoi(intData);
+    return (int) nativeInt(useBackup);
 }
 
 /*
@@ -480,10 +973,14 @@ long ADBColumn::toLong(int useBackup)
         intDataType != FIELD_TYPE_LONG &&
         intDataType != FIELD_TYPE_LONGLONG &&
         intDataType != FIELD_TYPE_INT24
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toLong(%d) - Warning! Column is not a long", intColumnNo);
+       ) {
+        if (!(typeWarnings & ADB_WARN_LONG)) {
+            typeWarnings |= ADB_WARN_LONG;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toLong(%d) - Warning! Column is not a long", intColumnNo);
+        }
+    }
 
-    if (useBackup) return atol(intOldData);
-    else return atol(intData);
+    return (long) nativeInt(useBackup);
 }
 
 /*
@@ -497,10 +994,14 @@ llong ADBColumn::toLLong(int useBackup)
         intDataType != FIELD_TYPE_LONG &&
         intDataType != FIELD_TYPE_LONGLONG &&
         intDataType != FIELD_TYPE_INT24
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toLLong(%d) - Warning! Column is not a long long", intColumnNo);
+       ) {
+        if (!(typeWarnings & ADB_WARN_LLONG)) {
+            typeWarnings |= ADB_WARN_LLONG;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toLLong(%d) - Warning! Column is not a long long", intColumnNo);
+        }
+    }
 
-    if (useBackup) return atoll(intOldData);
-    else return atoll(intData);
+    return nativeInt(useBackup);
 }
 
 
@@ -512,99 +1013,52 @@ float ADBColumn::toFloat(int useBackup)
 {
     if (intDataType != FIELD_TYPE_FLOAT &&
         intDataType != FIELD_TYPE_DOUBLE
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toFloat(%d:%s) - Warning! Column is not a float (type = %d)", intColumnNo, intColumnName, intDataType);
+       ) {
+        if (!(typeWarnings & ADB_WARN_FLOAT)) {
+            typeWarnings |= ADB_WARN_FLOAT;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toFloat(%d:%s) - Warning! Column is not a float (type = %d)", intColumnNo, intColumnName, intDataType);
+        }
+    }
 
-    if (useBackup) return atof(intOldData);
-    else return atof(intData);
+    return (float) nativeDbl(useBackup);
 }
 
 /*
-** toTime_t()  - Converts data to a time_t and returns it.
+** toDouble()  - Converts data to a double and returns it.
 */
 
-time_t ADBColumn::toTime_t(int useBackup)
+double ADBColumn::toDouble(int useBackup)
 {
-    if (intDataType != FIELD_TYPE_DATETIME &&
-        intDataType != FIELD_TYPE_TIMESTAMP
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toTime_t(%d) - Warning! Column is not a date", intColumnNo);
-
-    time_t  retVal = 0;
-    tm      t;
-    char    tmpSt1[256];
-    char    tmpSt2[256];
-
-    // This is a nasty, nasty, nasty, nasty way to do this, but my brain 
-    // has melted down for the day, and I can't think of a better way
-    // to do this right now, but I need the routine before I can continue on
-    // with other things.  Brute force, but it will work.
-
-    if (useBackup) { 
-        if (intOldData) strcpy(tmpSt1, intOldData);
-    } else {
-        if (intData) strcpy(tmpSt1, intData);
-    }
-
-    if (strlen(tmpSt1) == 14) {
-        // Its a time stamp in the form YYYYMMDDHHMMSS
-        if (!strcmp("00000000000000", tmpSt1)) {
-            retVal = (time_t) 0;
-        } else {
-            // Oh, god, this is ugly.
-            sprintf(tmpSt2, "%c%c%c%c", tmpSt1[0], tmpSt1[1], tmpSt1[2], tmpSt1[3]);
-            t.tm_year = atoi(tmpSt2) - 1900;
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[4], tmpSt1[5]);
-            t.tm_mon = atoi(tmpSt2) - 1;
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[6], tmpSt1[7]);
-            t.tm_mday = atoi(tmpSt2);
-
-            // Oh, nasty, nasty, nasty, I must kill myself before letting 
-            // anyone see this code.
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[8], tmpSt1[9]);
-            t.tm_hour = atoi(tmpSt2);
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[10], tmpSt1[11]);
-            t.tm_min = atoi(tmpSt2);
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[12], tmpSt1[13]);
-            t.tm_sec = atoi(tmpSt2);
-
-            retVal = mktime(&t);
+    if (intDataType != FIELD_TYPE_FLOAT &&
+        intDataType != FIELD_TYPE_DOUBLE
+       ) {
+        if (!(typeWarnings & ADB_WARN_FLOAT)) {
+            typeWarnings |= ADB_WARN_FLOAT;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toDouble(%d:%s) - Warning! Column is not a float (type = %d)", intColumnNo, intColumnName, intDataType);
         }
-    } else {
-        // Its a datetime in the form YYYY-MM-DD HH:MM:SS
-        // I should really be ashamed to call myself a programmer for
-        // writing shit this bad.
-        if (!strcmp("0000-00-00 00:00:00", tmpSt1)) {
-            retVal = (time_t) 0;
-        } else {
-            sprintf(tmpSt2, "%c%c%c%c", tmpSt1[0], tmpSt1[1], tmpSt1[2], tmpSt1[3]);
-            t.tm_year = atoi(tmpSt2) - 1900;
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[5], tmpSt1[6]);
-            t.tm_mon = atoi(tmpSt2) - 1;
-
-            sprintf(tmpSt2, "%c%c", tmpSt1[8], tmpSt1[9]);
-            t.tm_mday = atoi(tmpSt2);
-
-            // Oh, this is bad.
-            sprintf(tmpSt2, "%c%c", tmpSt1[11], tmpSt1[12]);
-            t.tm_hour = atoi(tmpSt2);
+    }
 
-            sprintf(tmpSt2, "%c%c", tmpSt1[14], tmpSt1[15]);
-            t.tm_min = atoi(tmpSt2);
+    return nativeDbl(useBackup);
+}
 
-            sprintf(tmpSt2, "%c%c", tmpSt1[17], tmpSt1[18]);
-            t.tm_sec = atoi(tmpSt2);
+/*
+** toTime_t()  - Converts data to a time_t and returns it.
+*/
 
-            retVal = mktime(&t);
+time_t ADBColumn::toTime_t(int useBackup)
+{
+    if (intDataType != FIELD_TYPE_DATETIME &&
+        intDataType != FIELD_TYPE_TIMESTAMP
+       ) {
+        if (!(typeWarnings & ADB_WARN_TIME_T)) {
+            typeWarnings |= ADB_WARN_TIME_T;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toTime_t(%d) - Warning! Column is not a date", intColumnNo);
         }
     }
 
-    
-    return retVal;
+    syncText(useBackup);
+    const char *src = useBackup ? intOldData : intData;
+    return (time_t) ADBDateTimeToEpoch(src, isView ? viewLen : strlen(src));
 }
 
 
@@ -619,11 +1073,17 @@ const QDate ADBColumn::toQDate(int useBackup)
     if (intDataType != FIELD_TYPE_DATE &&
         intDataType != FIELD_TYPE_DATETIME &&
         intDataType != FIELD_TYPE_TIMESTAMP
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toQDate(%d) - Warning! Column is not a date", intColumnNo);
+       ) {
+        if (!(typeWarnings & ADB_WARN_QDATE)) {
+            typeWarnings |= ADB_WARN_QDATE;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toQDate(%d) - Warning! Column is not a date", intColumnNo);
+        }
+    }
 
     QDate   retVal;
     QString tmpQStr;
 
+    syncText(useBackup);
     if (useBackup) tmpQStr = intOldData;
     else tmpQStr = intData;
 
@@ -643,11 +1103,17 @@ const QDate ADBColumn::toQDate(int useBackup)
 const QTime ADBColumn::toQTime(int useBackup)
 {
     if (intDataType != FIELD_TYPE_TIME
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toQDate(%d) - Warning! Column is not a date", intColumnNo);
+       ) {
+        if (!(typeWarnings & ADB_WARN_QTIME)) {
+            typeWarnings |= ADB_WARN_QTIME;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toQDate(%d) - Warning! Column is not a date", intColumnNo);
+        }
+    }
 
     QTime   retVal;
     QString tmpQStr;
 
+    syncText(useBackup);
     if (useBackup) tmpQStr = intOldData;
     else tmpQStr = intData;
 
@@ -668,13 +1134,19 @@ const QDateTime ADBColumn::toQDateTime(int useBackup)
 {
     if (intDataType != FIELD_TYPE_DATETIME &&
         intDataType != FIELD_TYPE_TIMESTAMP
-       ) ADBLogMsg(LOG_WARNING, "ADBColumn::toQDate(%d) - Warning! Column is not a date", intColumnNo);
+       ) {
+        if (!(typeWarnings & ADB_WARN_QDATETIME)) {
+            typeWarnings |= ADB_WARN_QDATETIME;
+            ADBLogMsg(LOG_WARNING, "ADBColumn::toQDate(%d) - Warning! Column is not a date", intColumnNo);
+        }
+    }
 
     QDateTime retVal;
     QDate     tmpDate;
     QTime     tmpTime;
     QString   tmpQStr;
 
+    syncText(useBackup);
     if (useBackup) tmpQStr = intOldData;
     else tmpQStr = intData;
 
@@ -720,71 +1192,77 @@ const QDateTime ADBColumn::toQDateTime(int useBackup)
 
 const char *ADBColumn::insStr()
 {
-    if (workStr) free(workStr);
+    insBuf.clear();
+    appendInsStr(&insBuf);
+    return insBuf.data();
+}
+
+/*
+** appendInsStr - Appends the insert string to a statement being built,
+**                escaping string data straight into it.
+*/
+
+void ADBColumn::appendInsStr(ADBStmtBuf *sql)
+{
     switch (intDataType) {
         case FIELD_TYPE_TINY:
         case FIELD_TYPE_SHORT:
-            workStr = (char *) calloc(32, sizeof(char));
-            sprintf(workStr, "%d", atoi(intData));
+            sql->appendLLong((int) nativeInt(0));
         break;
         
         case FIELD_TYPE_LONG:
-            workStr = (char *) calloc(32, sizeof(char));
-            sprintf(workStr, "%ld", atol(intData));
+            sql->appendLLong((long) nativeInt(0));
         break;
         
         case FIELD_TYPE_LONGLONG:
-            workStr = (char *) calloc(64, sizeof(char));
-            sprintf(workStr, "%qd", atoll(intData));
+            sql->appendLLong(nativeInt(0));
         break;
 
         case FIELD_TYPE_DOUBLE:
         case FIELD_TYPE_FLOAT:
-            workStr = (char *) calloc(64, sizeof(char));
-            sprintf(workStr, "%f", atof(intData));
+            sql->appendDouble(nativeDbl(0));
         break;
 
         // Everything else is a string, so escape it and wrap it in quotes.
         default:
             if (intIsEncrypted) {
-                workStr = (char *) calloc(16, sizeof(char));
                 encryptData();
-                int  tmpLen  = strlen(workStr);
-                char *tmpStr = (char *) calloc(tmpLen*2+32, sizeof(char));
-                mysql_escape_string(tmpStr, workStr, tmpLen);
-                free(workStr);
-                workStr = (char *) calloc(strlen(tmpStr)+64, sizeof(char));
-                strcpy(workStr, "'");
-                strcat(workStr, tmpStr);
-                strcat(workStr, "'");
-                free(tmpStr);
+                sql->appendQuoted(workStr, strlen(workStr));
             } else {
-                int tmpLen = 0;
-                if (intData) tmpLen = strlen(intData);
-                workStr = (char *) calloc(tmpLen * 2 + 16, sizeof(char));
-                char *tmpStr = (char *) calloc(tmpLen * 2 + 16, sizeof(char));
-                if (intData) mysql_escape_string(tmpStr, intData, tmpLen);
-                strcpy(workStr, "'");
-                strcat(workStr, tmpStr);
-                strcat(workStr, "'");
-                free(tmpStr);
+                ulong dataLen = Length();
+                sql->appendQuoted(intData, dataLen);
             }
         break;
     }
-    return workStr;
 }
 
 /*
-** decryptData()   - Decrypts the stuff in intData.
+** storedData - Returns the data as it is stored in the database, which is
+**              the encrypted form for encrypted columns.  Used when binding
+**              the column to a prepared statement.
+*/
+
+const char *ADBColumn::storedData()
+{
+    syncText(0);
+    if (intIsEncrypted) {
+        encryptData();
+        return workStr;
+    }
+    return intData;
+}
+
+/*
+** decryptData()   - Decrypts srcData into intData.
 */
 
-void ADBColumn::decryptData(void)
+void ADBColumn::decryptData(const char *srcData)
 {
-    ADBDebugMsg(7, "ADBColumn: Decrypting source string '%s'", intData);
-    char    *dst = (char *) calloc(strlen(intData)+128, sizeof(char));
-    decrypt_string((unsigned char *)intData, (unsigned char *) dst, intUseDefKey);
-    free (intData);
-    intData = dst;
+    ADBDebugMsg(7, "ADBColumn: Decrypting source string '%s'", srcData);
+    ulong   dstLen = strlen(srcData) + 128;
+    char    *dst = reserve(0, dstLen);
+    memset(dst, 0, dstLen);
+    decrypt_string((unsigned char *) srcData, (unsigned char *) dst, intUseDefKey);
     ADBDebugMsg(7, "ADBColumn: Decrypted string '%s'", intData);
 }
 
@@ -796,6 +1274,7 @@ void ADBColumn::decryptData(void)
 void ADBColumn::encryptData(void)
 {
     free(workStr);
+    syncText(0);
     ADBDebugMsg(7, "ADBColumn: Encrypting source string '%s'", intData);
     workStr = (char *) calloc((strlen(intData)*4)+128, sizeof(char));
     encrypt_string((unsigned char *)intData, (unsigned char *) workStr, intUseDefKey);
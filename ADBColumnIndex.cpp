@@ -0,0 +1,120 @@
+/**
+ * ADBColumnIndex.cpp - A hashed index of column names used by ADBRow and
+ *                      ADBTable.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <ADB.h>
+
+
+/*
+** ADBColumnIndexHash - FNV-1a hash of a column name.
+*/
+
+static inline uint ADBColumnIndexHash(const char *colName)
+{
+    uint    hash = 2166136261U;
+    for (const unsigned char *p = (const unsigned char *) colName; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/*
+** ADBColumnIndexCacheSlot - Picks the cache slot for a name's address.
+*/
+
+static inline uint ADBColumnIndexCacheSlot(const char *colName)
+{
+    return ((unsigned long) colName >> 3) & (ADB_COLINDEX_CACHE - 1);
+}
+
+/*
+** ADBColumnIndex::ADBColumnIndex - Creates an empty index.
+*/
+
+ADBColumnIndex::ADBColumnIndex()
+{
+    clear();
+}
+
+/*
+** ADBColumnIndex::clear - Forgets all of the columns.
+*/
+
+void ADBColumnIndex::clear()
+{
+    memset(names, 0, sizeof(names));
+    memset(slots, -1, sizeof(slots));
+    memset(cacheNames, 0, sizeof(cacheNames));
+    memset(cacheCols, 0, sizeof(cacheCols));
+}
+
+/*
+** ADBColumnIndex::add - Adds a column to the index.  If the name is
+**                       already there, the first column added keeps it.
+*/
+
+void ADBColumnIndex::add(const char *colName, uint colNo)
+{
+    if (!colName || colNo >= ADB_MAXCOLS) return;
+
+    uint    slot = ADBColumnIndexHash(colName) & (ADB_COLINDEX_SLOTS - 1);
+    while (slots[slot] >= 0) {
+        if (!strcmp(names[slots[slot]], colName)) return;
+        slot = (slot + 1) & (ADB_COLINDEX_SLOTS - 1);
+    }
+    names[colNo] = colName;
+    slots[slot]  = colNo;
+}
+
+/*
+** ADBColumnIndex::find - Returns the column number for a name, or
+**                        ADB_MAXCOLS if there is no such column.
+*/
+
+uint ADBColumnIndex::find(const char *colName)
+{
+    if (!colName) return ADB_MAXCOLS;
+
+    // Have we been asked for this exact string recently?
+    uint    cacheSlot = ADBColumnIndexCacheSlot(colName);
+    if (cacheNames[cacheSlot] == colName && !strcmp(names[cacheCols[cacheSlot]], colName)) {
+        return cacheCols[cacheSlot];
+    }
+
+    uint    slot = ADBColumnIndexHash(colName) & (ADB_COLINDEX_SLOTS - 1);
+    while (slots[slot] >= 0) {
+        if (!strcmp(names[slots[slot]], colName)) {
+            cacheNames[cacheSlot] = colName;
+            cacheCols[cacheSlot]  = slots[slot];
+            return slots[slot];
+        }
+        slot = (slot + 1) & (ADB_COLINDEX_SLOTS - 1);
+    }
+    return ADB_MAXCOLS;
+}
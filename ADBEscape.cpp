@@ -0,0 +1,238 @@
+/**
+ * ADBEscape.cpp - Escapes strings for use in SQL statements, skipping
+ *                 over the runs that need no escaping with SSE2 or AVX2.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * The escaping matches mysql_escape_string(): NUL, newline, carriage
+ * return, backslash, both quotes and Ctrl-Z get a backslash in front.
+ * All of them are below 0x80, so UTF-8 and the single byte character
+ * sets come out the same as they do from the client library.
+ *
+ * Most values have nothing to escape, so the work is in finding the next
+ * byte that does.  The scanners compare 16 or 32 bytes at a time against
+ * each of the seven special bytes.  The AVX2 scanner is compiled with a
+ * target attribute and only used if the CPU says it has AVX2, so the
+ * library itself doesn't need to be built with -mavx2.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ADB.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ADB_ESCAPE_X86
+#include <immintrin.h>
+#endif
+
+// What each byte is escaped as, or 0 if it is left alone.
+static const char ADBEscapeChars[256] = {
+    /* 0x00 */ '0', 0, 0, 0, 0, 0, 0, 0, 0, 0, 'n', 0, 0, 'r', 0, 0,
+    /* 0x10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'Z', 0, 0, 0, 0, 0,
+    /* 0x20 */ 0, 0, '"', 0, 0, 0, 0, '\'', 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x30 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x40 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+typedef ulong (*ADBEscapeScanFunc)(const char *src, ulong len);
+
+/*
+** ADBEscapeScanScalar - Returns the offset of the first byte that needs
+**                       escaping, or len if none do.
+*/
+
+static ulong ADBEscapeScanScalar(const char *src, ulong len)
+{
+    ulong   pos = 0;
+    while (pos < len && !ADBEscapeChars[(unsigned char) src[pos]]) pos++;
+    return pos;
+}
+
+#ifdef ADB_ESCAPE_X86
+
+/*
+** ADBEscapeMask16 - Returns a bit for each of the 16 bytes at src that
+**                   needs escaping.  Always inlined, so that inside the
+**                   AVX2 scanner it is VEX encoded as well; mixing in
+**                   legacy SSE instructions there costs more than the
+**                   whole scan of a short string.
+*/
+
+static inline __attribute__((always_inline)) uint ADBEscapeMask16(const char *src)
+{
+    __m128i chunk = _mm_loadu_si128((const __m128i *) src);
+    __m128i hits  = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_setzero_si128()),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                     _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')))),
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\'')),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\032'))));
+    return (uint) _mm_movemask_epi8(hits);
+}
+
+/*
+** ADBEscapeScanSSE2 - The scanner, 16 bytes at a time.
+*/
+
+static ulong ADBEscapeScanSSE2(const char *src, ulong len)
+{
+    ulong   pos = 0;
+    for (; pos + 16 <= len; pos += 16) {
+        uint    mask = ADBEscapeMask16(src + pos);
+        if (mask) return pos + __builtin_ctz(mask);
+    }
+    return pos + ADBEscapeScanScalar(src + pos, len - pos);
+}
+
+/*
+** ADBEscapeScanAVX2 - The scanner, 32 bytes at a time.
+*/
+
+__attribute__((target("avx2")))
+static ulong ADBEscapeScanAVX2(const char *src, ulong len)
+{
+    const __m256i   nul   = _mm256_setzero_si256();
+    const __m256i   nl    = _mm256_set1_epi8('\n');
+    const __m256i   cr    = _mm256_set1_epi8('\r');
+    const __m256i   bs    = _mm256_set1_epi8('\\');
+    const __m256i   sq    = _mm256_set1_epi8('\'');
+    const __m256i   dq    = _mm256_set1_epi8('"');
+    const __m256i   ctrlz = _mm256_set1_epi8('\032');
+    ulong           pos   = 0;
+
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (src + pos));
+        __m256i hits  = _mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, nul), _mm256_cmpeq_epi8(chunk, nl)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr),  _mm256_cmpeq_epi8(chunk, bs))),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, sq),  _mm256_cmpeq_epi8(chunk, dq)),
+                            _mm256_cmpeq_epi8(chunk, ctrlz)));
+        uint    mask  = (uint) _mm256_movemask_epi8(hits);
+        if (mask) return pos + __builtin_ctz(mask);
+    }
+    if (pos + 16 <= len) {
+        uint    mask = ADBEscapeMask16(src + pos);
+        if (mask) return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+    return pos + ADBEscapeScanScalar(src + pos, len - pos);
+}
+
+#endif  // ADB_ESCAPE_X86
+
+// The scanner in use and its level.  Picked the first time it's needed.
+static ADBEscapeScanFunc    ADBEscapeScan  = NULL;
+static int                  ADBEscapeLevel = -1;
+
+/*
+** ADBBestEscapeLevel - Returns the fastest scanner this CPU can run.
+*/
+
+static int ADBBestEscapeLevel(void)
+{
+#ifdef ADB_ESCAPE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return ADB_ESCAPE_AVX2;
+    if (__builtin_cpu_supports("sse2")) return ADB_ESCAPE_SSE2;
+#endif
+    return ADB_ESCAPE_SCALAR;
+}
+
+/*
+** ADBSetEscapeLevel - Picks the scanner, limited to what the CPU can run.
+**                     Normally the best one is picked automatically; this
+**                     is for testing and benchmarks.  Returns the level
+**                     actually used.
+*/
+
+int ADBSetEscapeLevel(int newLevel)
+{
+    int     best = ADBBestEscapeLevel();
+    if (newLevel > best || newLevel < 0) newLevel = best;
+
+    ADBEscapeScanFunc   scan = ADBEscapeScanScalar;
+#ifdef ADB_ESCAPE_X86
+    if (newLevel == ADB_ESCAPE_AVX2) scan = ADBEscapeScanAVX2;
+    else if (newLevel == ADB_ESCAPE_SSE2) scan = ADBEscapeScanSSE2;
+#endif
+
+    // Two threads racing to set this up will pick the same thing.
+    ADBEscapeScan  = scan;
+    ADBEscapeLevel = newLevel;
+    return newLevel;
+}
+
+/*
+** ADBGetEscapeLevel - Returns the scanner in use.
+*/
+
+int ADBGetEscapeLevel(void)
+{
+    if (!ADBEscapeScan) ADBSetEscapeLevel(-1);
+    return ADBEscapeLevel;
+}
+
+/*
+** ADBEscapeString - Escapes len bytes of from into to, which must have
+**                   room for len * 2 + 1 bytes, and NUL terminates it.
+**                   Returns the length of the escaped string.  A drop in
+**                   replacement for mysql_escape_string().
+*/
+
+ulong ADBEscapeString(char *to, const char *from, ulong len)
+{
+    ADBEscapeScanFunc   scan = ADBEscapeScan;
+    if (!scan) {
+        ADBSetEscapeLevel(-1);
+        scan = ADBEscapeScan;
+    }
+
+    char    *dst = to;
+    ulong   pos  = 0;
+    while (pos < len) {
+        // Copy the clean run up to the next byte that needs escaping.
+        ulong   clean = scan(from + pos, len - pos);
+        memcpy(dst, from + pos, clean);
+        dst += clean;
+        pos += clean;
+
+        // Escape that byte and any that follow it straight away, so that
+        // a string full of quotes doesn't go back to the scanner for each.
+        char    esc;
+        while (pos < len && (esc = ADBEscapeChars[(unsigned char) from[pos]])) {
+            *dst++ = '\\';
+            *dst++ = esc;
+            pos++;
+        }
+    }
+    *dst = '\0';
+    return dst - to;
+}
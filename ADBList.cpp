@@ -27,10 +27,68 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <syslog.h>
+#include <pthread.h>
 #include <ADB.h>
+#include <mysql/mysql.h>
 #include "bdes.h"
 
 
+// Used to match the rows in a prefetch window back to their list position.
+struct ADBListKeyPos
+{
+    long    key;
+    long    pos;
+};
+
+static int ADBListKeyCmp(const void *a, const void *b)
+{
+    long ka = ((const ADBListKeyPos *) a)->key;
+    long kb = ((const ADBListKeyPos *) b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+// A parallel walk, shared by the calling thread and its workers.
+struct ADBParallelJob
+{
+    const char      *table;
+    const char      *name;
+    const char      *user;
+    const char      *pass;
+    const char      *host;
+    const char      *pkName;
+    const char      *condition;
+    int             encrypted[ADB_MAXCOLS];
+    uint            numColumns;
+
+    ADBRowFunc      rowFunc;
+    void            *userData;
+
+    uint            numRanges;
+    ADBRangeResult  *ranges;
+    int             *done;
+    uint            nextRange;
+    uint            liveWorkers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  finished;
+};
+
+/*
+** ADBListSkipWhere - Skips over a leading "where", so conditions can be
+**                    given the same way as they are to getList.
+*/
+
+static const char *ADBListSkipWhere(const char *condition)
+{
+    if (!condition) return NULL;
+    while (isspace(*condition)) condition++;
+    if (!strncasecmp(condition, "where", 5) && isspace(condition[5])) condition += 5;
+    while (isspace(*condition)) condition++;
+    return *condition ? condition : NULL;
+}
 
 
 ADBList::ADBList(
@@ -44,6 +102,18 @@ ADBList::ADBList(
     keyList  = NULL;
     totKeys  = 0;
     curKeyNo = 0;
+
+    prefetchSize = 0;
+    winRes       = NULL;
+    winRows      = NULL;
+    winStart     = 0;
+    winEnd       = 0;
+
+    keysetMode   = 0;
+    keysetCond   = NULL;
+    keysetPage   = 0;
+    keysetLast   = 0;
+    keysetRows   = 0;
 }
 
 ADBList::~ADBList()
@@ -52,6 +122,26 @@ ADBList::~ADBList()
         free(keyList);
         keyList = NULL;
     }
+    endKeyset();
+    freeWindow();
+    if (winRows) free(winRows);
+}
+
+/*
+** ADBList::setPrefetch() - Sets the number of rows to load at a time
+**                          while traversing the list.  0 loads each row
+**                          as it is reached.
+*/
+
+void ADBList::setPrefetch(long windowSize)
+{
+    freeWindow();
+    if (winRows) {
+        free(winRows);
+        winRows = NULL;
+    }
+    prefetchSize = windowSize > 0 ? windowSize : 0;
+    if (prefetchSize) winRows = (MYSQL_ROW *) calloc(prefetchSize, sizeof(MYSQL_ROW));
 }
 
 /*
@@ -70,6 +160,8 @@ long ADBList::getList(const char *listQuery)
     
     totKeys  = 0;
     curKeyNo = 0;
+    endKeyset();
+    freeWindow();
 
     if (numColumns) {
         char *myListQuery = NULL;
@@ -89,9 +181,11 @@ long ADBList::getList(const char *listQuery)
             totKeys = rowCount;
             retVal  = rowCount;
 
+            // Only the key is needed, so skip loading each row into curRow.
+            MYSQL_ROW   keyRow;
             keyList = (long *) calloc(totKeys+1, sizeof(long));
-            while (getrow()) {
-                keyList[curKeyNo] = atol(curRow[0]);
+            while ((keyRow = mysql_fetch_row(queryRes))) {
+                keyList[curKeyNo] = keyRow[0] ? atol(keyRow[0]) : 0;
                 curKeyNo++;
             }
             first();
@@ -114,10 +208,13 @@ long ADBList::getList(const char *listQuery)
 long ADBList::first(void)
 {
     long    retVal = 0;
+    if (keysetMode) {
+        if (loadPage(1)) retVal = nextInPage();
+        return retVal;
+    }
     if (totKeys) {
         curKeyNo = 0;
-        retVal   = keyList[curKeyNo];
-        get(keyList[retVal]);
+        retVal   = loadKey(curKeyNo);
     }
     return retVal;
 }
@@ -133,10 +230,13 @@ long ADBList::first(void)
 long ADBList::last(void)
 {
     long    retVal = 0;
+    if (keysetMode) {
+        ADBLogMsg(LOG_WARNING, "ADBList::last() - Not available on a streamed list");
+        return retVal;
+    }
     if (totKeys) {
         curKeyNo = totKeys - 1;
-        retVal   = keyList[curKeyNo];
-        get(keyList[retVal]);
+        retVal   = loadKey(curKeyNo);
     }
     return retVal;
 }
@@ -152,11 +252,14 @@ long ADBList::last(void)
 long ADBList::prev(void)
 {
     long    retVal = 0;
+    if (keysetMode) {
+        ADBLogMsg(LOG_WARNING, "ADBList::prev() - Not available on a streamed list");
+        return retVal;
+    }
     if (totKeys) {
         if (curKeyNo > 0) {
             curKeyNo--;
-            retVal   = keyList[curKeyNo];
-            get(keyList[retVal]);
+            retVal   = loadKey(curKeyNo);
         }
     }
     return retVal;
@@ -173,15 +276,450 @@ long ADBList::prev(void)
 long ADBList::next(void)
 {
     long    retVal = 0;
+    if (keysetMode) return nextInPage();
     if (totKeys) {
         if (curKeyNo < totKeys - 1) {
             curKeyNo++;
-            retVal   = keyList[curKeyNo];
-            get(keyList[retVal]);
+            retVal   = loadKey(curKeyNo);
         }
     }
     return retVal;
 }
 
+/*
+** ADBList::loadKey() - Loads the row for a position in the list, either
+**                      from the prefetch window or with get().
+**
+**                      Returns the primary key value for the row.
+*/
+
+long ADBList::loadKey(long keyNo)
+{
+    long    keyVal = keyList[keyNo];
+    if (prefetchSize && (keyNo < winStart || keyNo >= winEnd || !winRes)) {
+        loadWindow(keyNo);
+    }
+
+    if (prefetchSize && winRes && keyNo >= winStart && keyNo < winEnd && winRows[keyNo - winStart]) {
+        loadColumns(winRows[keyNo - winStart]);
+        rowCount = 1;
+    } else {
+        // Not prefetching, or the row has vanished since we got the list.
+        get(keyVal);
+    }
+    return keyVal;
+}
 
+/*
+** ADBList::loadWindow() - Loads the rows for the window of keys around
+**                         keyNo.  Moving backwards through the list loads
+**                         the window that ends at keyNo, otherwise it
+**                         starts there.
+**
+**                         Returns 1 if successful.
+*/
 
+int ADBList::loadWindow(long keyNo)
+{
+    long    start = keyNo;
+    if (winRes && keyNo < winStart) {
+        start = keyNo - prefetchSize + 1;
+        if (start < 0) start = 0;
+    }
+    long    end   = start + prefetchSize;
+    if (end > totKeys) end = totKeys;
+    freeWindow();
+
+    // Build the query.  Keys are at most 20 digits and a comma.
+    const char  *pkName = columnDefs[primaryKeyColumn]->ColumnName();
+    char        *qStr   = (char *) calloc(strlen(TableName) + strlen(pkName) + 64 + (end - start) * 22, sizeof(char));
+    char        *pos    = qStr;
+    pos += sprintf(pos, "SELECT * FROM %s WHERE %s IN (", TableName, pkName);
+    for (long i = start; i < end; i++) {
+        pos += sprintf(pos, i > start ? ",%ld" : "%ld", keyList[i]);
+    }
+    *pos++ = ')';
+    *pos   = '\0';
+
+    drainStream("ADBList::loadWindow()");
+    ADBDebugMsg(2, "ADBList: Loading rows %ld to %ld of %ld", start, end - 1, totKeys);
+    if (mysql_real_query(MySock, qStr, pos - qStr) || !(winRes = mysql_store_result(MySock))) {
+        ADBLogMsg(LOG_ERR, "ADBList: MySQL error loading rows from '%s': '%s'", TableName, mysql_error(MySock));
+        free(qStr);
+        return 0;
+    }
+    free(qStr);
+
+    if (mysql_num_fields(winRes) != numColumns) {
+        ADBLogMsg(LOG_ERR, "ADBList: '%s' returned %u columns, expected %u", TableName, mysql_num_fields(winRes), numColumns);
+        freeWindow();
+        return 0;
+    }
+
+    // The rows come back in key order, not list order, so match them up.
+    long            count = end - start;
+    ADBListKeyPos   *map  = (ADBListKeyPos *) calloc(count, sizeof(ADBListKeyPos));
+    for (long i = 0; i < count; i++) {
+        map[i].key = keyList[start + i];
+        map[i].pos = i;
+    }
+    qsort(map, count, sizeof(ADBListKeyPos), ADBListKeyCmp);
+    memset(winRows, 0, prefetchSize * sizeof(MYSQL_ROW));
+
+    MYSQL_ROW   row;
+    while ((row = mysql_fetch_row(winRes))) {
+        ADBListKeyPos   want;
+        want.key = row[primaryKeyColumn] ? atol(row[primaryKeyColumn]) : 0;
+        ADBListKeyPos   *found = (ADBListKeyPos *) bsearch(&want, map, count, sizeof(ADBListKeyPos), ADBListKeyCmp);
+        if (found) winRows[found->pos] = row;
+    }
+    free(map);
+
+    winStart = start;
+    winEnd   = end;
+    return 1;
+}
+
+/*
+** ADBList::freeWindow() - Frees the rows in the current prefetch window.
+*/
+
+void ADBList::freeWindow(void)
+{
+    if (winRes) {
+        mysql_free_result(winRes);
+        winRes = NULL;
+    }
+    winStart = 0;
+    winEnd   = 0;
+}
+
+/*
+** ADBList::streamList() - Starts walking the rows that match condition in
+**                         primary key order, a page at a time, and loads
+**                         the first one.
+**
+**                         Returns the primary key value for the first row
+**                         or 0 if there weren't any.
+*/
+
+long ADBList::streamList(const char *condition, long pageSize)
+{
+    if (keyList) {
+        free(keyList);
+        keyList = NULL;
+    }
+    totKeys  = 0;
+    curKeyNo = 0;
+    endKeyset();
+    freeWindow();
+
+    if (!numColumns || primaryKeyColumn >= numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBList::streamList() - No primary key defined for table '%s'", TableName);
+        return 0;
+    }
+
+    // Allow the same "where ..." that getList takes.
+    condition = ADBListSkipWhere(condition);
+    if (condition) keysetCond = strdup(condition);
+    keysetPage = pageSize > 0 ? pageSize : 1000;
+    keysetMode = 1;
+
+    return first();
+}
+
+/*
+** ADBList::loadPage() - Loads the next page of a streamed list, or the
+**                       first one if firstPage is set.
+**
+**                       Returns 1 if successful.
+*/
+
+int ADBList::loadPage(int firstPage)
+{
+    freeWindow();
+    keysetRows = 0;
+
+    const char  *pkName = columnDefs[primaryKeyColumn]->ColumnName();
+    char        *qStr   = (char *) calloc(strlen(TableName) + 2 * strlen(pkName) + (keysetCond ? strlen(keysetCond) : 0) + 128, sizeof(char));
+    char        *pos    = qStr;
+    pos += sprintf(pos, "SELECT * FROM %s", TableName);
+    if (keysetCond || !firstPage) pos += sprintf(pos, " WHERE ");
+    if (keysetCond) pos += sprintf(pos, "(%s)", keysetCond);
+    if (keysetCond && !firstPage) pos += sprintf(pos, " AND ");
+    if (!firstPage) pos += sprintf(pos, "%s > %ld", pkName, keysetLast);
+    pos += sprintf(pos, " ORDER BY %s LIMIT %ld", pkName, keysetPage);
+
+    drainStream("ADBList::loadPage()");
+    ADBDebugMsg(2, "ADBList: Loading page '%s'", qStr);
+    if (mysql_real_query(MySock, qStr, pos - qStr) || !(winRes = mysql_store_result(MySock))) {
+        ADBLogMsg(LOG_ERR, "ADBList: MySQL error on query.  Query: '%s', Error: '%s'", qStr, mysql_error(MySock));
+        free(qStr);
+        return 0;
+    }
+    free(qStr);
+
+    if (mysql_num_fields(winRes) != numColumns) {
+        ADBLogMsg(LOG_ERR, "ADBList: '%s' returned %u columns, expected %u", TableName, mysql_num_fields(winRes), numColumns);
+        freeWindow();
+        return 0;
+    }
+    return 1;
+}
+
+/*
+** ADBList::nextInPage() - Loads the next row of a streamed list, fetching
+**                         the next page when this one runs out.
+**
+**                         Returns the primary key value for the row, or 0
+**                         at the end of the list.
+*/
+
+long ADBList::nextInPage(void)
+{
+    if (!winRes) return 0;
+
+    MYSQL_ROW   row = mysql_fetch_row(winRes);
+    if (!row) {
+        // A short page was the last one.
+        if (keysetRows < keysetPage) {
+            freeWindow();
+            return 0;
+        }
+        if (!loadPage(0) || !(row = mysql_fetch_row(winRes))) {
+            freeWindow();
+            return 0;
+        }
+    }
+    keysetRows++;
+
+    loadColumns(row);
+    rowCount   = 1;
+    keysetLast = row[primaryKeyColumn] ? atol(row[primaryKeyColumn]) : 0;
+    return keysetLast;
+}
+
+/*
+** ADBList::endKeyset() - Turns off streaming mode.
+*/
+
+void ADBList::endKeyset(void)
+{
+    if (keysetCond) {
+        free(keysetCond);
+        keysetCond = NULL;
+    }
+    keysetMode = 0;
+    keysetRows = 0;
+    keysetLast = 0;
+}
+
+/*
+** ADBList::forEachParallel() - Walks the rows matching condition on
+**                              several threads at once.  The key space
+**                              between the lowest and highest matching
+**                              keys is cut into equal ranges, more of
+**                              them than there are threads so that a
+**                              slow range doesn't hold everyone up.
+**
+**                              Returns the number of rows walked.
+*/
+
+long ADBList::forEachParallel(
+  const char *condition,
+  uint numThreads,
+  ADBRowFunc rowFunc,
+  void *userData,
+  ADBRangeFunc rangeFunc,
+  bool ordered,
+  ADBParallelStats *stats
+)
+{
+    ADBParallelStats    totals;
+    memset(&totals, 0, sizeof(totals));
+    if (stats) memset(stats, 0, sizeof(ADBParallelStats));
+
+    if (!numColumns || primaryKeyColumn >= numColumns || !rowFunc) {
+        ADBLogMsg(LOG_WARNING, "ADBList::forEachParallel() - No primary key or row function for table '%s'", TableName);
+        return 0;
+    }
+    if (!numThreads) numThreads = 1;
+
+    // Find the key space we're working with.
+    condition = ADBListSkipWhere(condition);
+    const char  *pkName = columnDefs[primaryKeyColumn]->ColumnName();
+    if (condition) {
+        query("SELECT MIN(%s), MAX(%s) FROM %s WHERE %s", pkName, pkName, TableName, condition);
+    } else {
+        query("SELECT MIN(%s), MAX(%s) FROM %s", pkName, pkName, TableName);
+    }
+    if (!getrow() || !curRow[0] || !curRow[1]) return 0;
+    long    minKey = atol(curRow[0]);
+    long    maxKey = atol(curRow[1]);
+
+    ADBParallelJob  job;
+    memset(&job, 0, sizeof(job));
+    job.table      = TableName;
+    job.name       = DBName;
+    job.user       = DBUser;
+    job.pass       = DBPass;
+    job.host       = DBHost;
+    job.pkName     = pkName;
+    job.condition  = condition;
+    job.numColumns = numColumns;
+    for (uint i = 0; i < numColumns; i++) job.encrypted[i] = columnDefs[i]->Encrypted();
+    job.rowFunc    = rowFunc;
+    job.userData   = userData;
+
+    // Four ranges per thread, but never more ranges than keys.
+    ulong   span   = (ulong) (maxKey - minKey) + 1;
+    job.numRanges  = numThreads * 4;
+    if (span < job.numRanges) job.numRanges = span;
+    ulong   width  = span / job.numRanges;
+    job.ranges     = (ADBRangeResult *) calloc(job.numRanges, sizeof(ADBRangeResult));
+    job.done       = (int *) calloc(job.numRanges, sizeof(int));
+    for (uint i = 0; i < job.numRanges; i++) {
+        job.ranges[i].rangeNo  = i;
+        job.ranges[i].firstKey = minKey + (long) (i * width);
+        job.ranges[i].lastKey  = i == job.numRanges - 1 ? maxKey : minKey + (long) ((i + 1) * width) - 1;
+    }
+    if (numThreads > job.numRanges) numThreads = job.numRanges;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.finished, NULL);
+
+    ADBDebugMsg(1, "ADBList::forEachParallel() - Walking %s keys %ld to %ld in %u ranges on %u threads", TableName, minKey, maxKey, job.numRanges, numThreads);
+
+    pthread_t   *threads = (pthread_t *) calloc(numThreads, sizeof(pthread_t));
+    uint        started  = 0;
+    pthread_mutex_lock(&job.lock);
+    for (uint i = 0; i < numThreads; i++) {
+        if (pthread_create(&threads[started], NULL, parallelWorker, &job)) {
+            ADBLogMsg(LOG_ERR, "ADBList::forEachParallel() - Unable to start worker thread %u", i);
+        } else {
+            started++;
+            job.liveWorkers++;
+        }
+    }
+    if (!started) {
+        // No one to do the work.
+        for (uint i = 0; i < job.numRanges; i++) {
+            job.ranges[i].failed = 1;
+            job.done[i]          = 1;
+        }
+        job.nextRange = job.numRanges;
+    }
+
+    // Report the ranges as they finish.
+    uint    delivered = 0;
+    int     *reported = (int *) calloc(job.numRanges, sizeof(int));
+    while (delivered < job.numRanges) {
+        bool    progress = false;
+        for (uint i = 0; i < job.numRanges; i++) {
+            if (reported[i]) continue;
+            if (!job.done[i]) {
+                if (ordered) break;
+                continue;
+            }
+            reported[i] = 1;
+            delivered++;
+            progress = true;
+
+            ADBRangeResult  *r = &job.ranges[i];
+            totals.ranges++;
+            totals.rows   += r->rows;
+            totals.errors += r->errors;
+            if (r->failed) totals.failedRanges++;
+            if (r->firstErrorKey && !totals.firstErrorKey) totals.firstErrorKey = r->firstErrorKey;
+
+            if (rangeFunc) {
+                ADBRangeResult  result = *r;
+                pthread_mutex_unlock(&job.lock);
+                rangeFunc(&result, userData);
+                pthread_mutex_lock(&job.lock);
+            }
+        }
+        if (!progress && delivered < job.numRanges) pthread_cond_wait(&job.finished, &job.lock);
+    }
+    pthread_mutex_unlock(&job.lock);
+
+    for (uint i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    if (totals.errors || totals.failedRanges) {
+        ADBLogMsg(LOG_WARNING, "ADBList::forEachParallel() - %s: %ld rows, %ld errors, %u of %u ranges failed", TableName, totals.rows, totals.errors, totals.failedRanges, totals.ranges);
+    }
+    if (stats) *stats = totals;
+
+    free(reported);
+    free(threads);
+    free(job.ranges);
+    free(job.done);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.finished);
+    return totals.rows;
+}
+
+/*
+** ADBList::parallelWorker() - A worker thread for forEachParallel.  Takes
+**                             ranges until there are none left and walks
+**                             each one with a streamed list.
+*/
+
+void *ADBList::parallelWorker(void *jobPtr)
+{
+    ADBParallelJob  *job  = (ADBParallelJob *) jobPtr;
+    ADBList         *list = NULL;
+
+    mysql_thread_init();
+    list = new ADBList(job->table, job->name, job->user, job->pass, job->host);
+    if (!list->Connected() || list->numColumns != job->numColumns) {
+        ADBLogMsg(LOG_ERR, "ADBList::forEachParallel() - Worker unable to open '%s'", job->table);
+        delete list;
+        list = NULL;
+    } else {
+        for (uint i = 0; i < job->numColumns; i++) {
+            if (job->encrypted[i]) list->setEncryptedColumn(i);
+        }
+    }
+
+    uint    condSize = (job->condition ? strlen(job->condition) : 0) + 2 * strlen(job->pkName) + 96;
+    char    *cond    = (char *) calloc(condSize, sizeof(char));
+
+    pthread_mutex_lock(&job->lock);
+    while (list && job->nextRange < job->numRanges) {
+        ADBRangeResult  *r = &job->ranges[job->nextRange++];
+        pthread_mutex_unlock(&job->lock);
+
+        char    *pos = cond;
+        if (job->condition) pos += sprintf(pos, "(%s) AND ", job->condition);
+        sprintf(pos, "%s >= %ld AND %s <= %ld", job->pkName, r->firstKey, job->pkName, r->lastKey);
+
+        for (long keyVal = list->streamList(cond); keyVal; keyVal = list->next()) {
+            r->rows++;
+            if (job->rowFunc(list, keyVal, job->userData)) {
+                r->errors++;
+                if (!r->firstErrorKey) r->firstErrorKey = keyVal;
+            }
+        }
+        if (mysql_errno(list->MySock)) r->failed = 1;
+
+        pthread_mutex_lock(&job->lock);
+        job->done[r->rangeNo] = 1;
+        pthread_cond_signal(&job->finished);
+    }
+
+    // If we were the last worker standing, nobody is left to do the rest.
+    job->liveWorkers--;
+    if (!job->liveWorkers) {
+        while (job->nextRange < job->numRanges) {
+            job->ranges[job->nextRange].failed = 1;
+            job->done[job->nextRange++] = 1;
+        }
+        pthread_cond_signal(&job->finished);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    free(cond);
+    if (list) delete list;
+    mysql_thread_end();
+    return NULL;
+}
@@ -0,0 +1,378 @@
+/**
+ * ADBLog.cpp - An optional asynchronous sink for ADBLogMsg and
+ *              ADBDebugMsg.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * When the sink is running, ADBLogMsg() formats its message on the
+ * caller's thread as always, copies it into a slot in a fixed size ring
+ * and returns.  A background thread takes the messages off the ring and
+ * writes them to syslog and/or stderr, so a burst of errors doesn't make
+ * every worker wait on I/O.
+ *
+ * The ring is a bounded multi-producer queue: each slot carries a
+ * sequence number that tells producers and the consumer whose turn it is,
+ * so pushing a message is a compare-and-swap and a copy with no locks.
+ * When the ring is full we either count the message as dropped or spin
+ * until there is room, depending on the overflow policy.
+ *
+ * Messages longer than ADB_LOGRECSIZE are truncated.  The sink flushes
+ * itself when the process exits.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <ADB.h>
+
+struct ADBLogRecord
+{
+    ulong           seq;
+    int             priority;
+    char            msg[ADB_LOGRECSIZE];
+};
+
+// The ring.  ADBLogEnqueue and ADBLogDequeue only ever grow; a position
+// maps to slot (pos & ADBLogMask).
+static  ADBLogRecord    *ADBLogRing     = NULL;
+static  ulong           ADBLogMask      = 0;
+static  ulong           ADBLogEnqueue   = 0;
+static  ulong           ADBLogDequeue   = 0;
+static  ulong           ADBLogWritten   = 0;
+static  ulong           ADBLogDropped   = 0;
+
+// Producers that are somewhere inside push().  stop() waits for them
+// before it frees the ring.
+static  int             ADBLogProducers = 0;
+static  int             ADBLogRunning   = 0;
+static  int             ADBLogPolicy    = ADB_LOG_DROP;
+
+static  pthread_t       ADBLogThread;
+static  pthread_mutex_t ADBLogLock      = PTHREAD_MUTEX_INITIALIZER;
+static  pthread_cond_t  ADBLogWake      = PTHREAD_COND_INITIALIZER;
+static  int             ADBLogSleeping  = 0;
+static  int             ADBLogQuit      = 0;
+static  bool            ADBLogAtExitSet = false;
+
+/*
+** ADBLogPop - Takes the next message off of the ring and writes it.
+**             Returns false if the ring is empty.
+*/
+
+static bool ADBLogPop()
+{
+    ulong pos = __atomic_load_n(&ADBLogDequeue, __ATOMIC_RELAXED);
+    ADBLogRecord *rec = &ADBLogRing[pos & ADBLogMask];
+    ulong seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+    // If the producer hasn't finished with this slot, we're caught up.
+    if (seq != pos + 1) return false;
+
+    // We're the only consumer, so no need to compete for the slot.
+    __atomic_store_n(&ADBLogDequeue, pos + 1, __ATOMIC_RELAXED);
+    ADBLogOutput(rec->priority, rec->msg);
+
+    // Hand the slot back to the producers for its next lap.
+    __atomic_store_n(&rec->seq, pos + ADBLogMask + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&ADBLogWritten, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+** ADBLogReportDrops - Logs how many messages have been dropped since the
+**                     last report.
+*/
+
+static void ADBLogReportDrops(ulong *reported)
+{
+    ulong dropped = __atomic_load_n(&ADBLogDropped, __ATOMIC_RELAXED);
+    if (dropped != *reported) {
+        char tmpStr[128];
+        sprintf(tmpStr, "ADBLog: %lu log messages dropped, the log ring was full", dropped - *reported);
+        ADBLogOutput(LOG_WARNING, tmpStr);
+        *reported = dropped;
+    }
+}
+
+/*
+** ADBLogDrain - The background thread.  Writes messages as they arrive,
+**               sleeping when there is nothing to do.
+*/
+
+static void *ADBLogDrain(void *)
+{
+    ulong   reported   = __atomic_load_n(&ADBLogDropped, __ATOMIC_RELAXED);
+    time_t  lastReport = 0;
+
+    for (;;) {
+        while (ADBLogPop());
+
+        // Let someone know if we've been losing messages, but not more
+        // than once a second.
+        time_t now = time(NULL);
+        if (now != lastReport) {
+            ADBLogReportDrops(&reported);
+            lastReport = now;
+        }
+
+        pthread_mutex_lock(&ADBLogLock);
+        if (ADBLogQuit) {
+            pthread_mutex_unlock(&ADBLogLock);
+            break;
+        }
+        // Producers only signal us when we say we're asleep.  If one gets
+        // in between our last check and the wait, the timeout catches it.
+        __atomic_store_n(&ADBLogSleeping, 1, __ATOMIC_SEQ_CST);
+        if (!ADBLogPop()) {
+            struct timeval  now;
+            struct timespec deadline;
+            gettimeofday(&now, NULL);
+            deadline.tv_sec  = now.tv_sec;
+            deadline.tv_nsec = (now.tv_usec + 100000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&ADBLogWake, &ADBLogLock, &deadline);
+        }
+        __atomic_store_n(&ADBLogSleeping, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&ADBLogLock);
+    }
+
+    // Anything that was left.
+    while (ADBLogPop());
+    ADBLogReportDrops(&reported);
+    return NULL;
+}
+
+/*
+** ADBLogAtExit - Writes any messages still on the ring before the process
+**                goes away.
+*/
+
+static void ADBLogAtExit()
+{
+    ADBLog::stop();
+}
+
+/*
+** ADBLog::start - Starts the asynchronous sink with a ring of at least
+**                 the given number of slots.  Returns 1 if the sink is
+**                 running.
+*/
+
+int ADBLog::start(uint slots, int overflowPolicy)
+{
+    pthread_mutex_lock(&ADBLogLock);
+    if (ADBLogRing) {
+        // Already running.  Just take the new policy.
+        ADBLogPolicy = overflowPolicy;
+        pthread_mutex_unlock(&ADBLogLock);
+        return 1;
+    }
+
+    // The ring size must be a power of two.
+    ulong size = 2;
+    while (size < slots) size <<= 1;
+
+    ADBLogRing = (ADBLogRecord *) calloc(size, sizeof(ADBLogRecord));
+    if (!ADBLogRing) {
+        pthread_mutex_unlock(&ADBLogLock);
+        ADBLogMsg(LOG_ERR, "ADBLog::start() - Unable to allocate %lu log slots", size);
+        return 0;
+    }
+    for (ulong i = 0; i < size; i++) ADBLogRing[i].seq = i;
+    ADBLogMask    = size - 1;
+    ADBLogEnqueue = 0;
+    ADBLogDequeue = 0;
+    ADBLogWritten = 0;
+    ADBLogPolicy  = overflowPolicy;
+    ADBLogQuit    = 0;
+
+    if (pthread_create(&ADBLogThread, NULL, ADBLogDrain, NULL)) {
+        free(ADBLogRing);
+        ADBLogRing = NULL;
+        pthread_mutex_unlock(&ADBLogLock);
+        ADBLogMsg(LOG_ERR, "ADBLog::start() - Unable to start the log thread");
+        return 0;
+    }
+
+    if (!ADBLogAtExitSet) {
+        atexit(ADBLogAtExit);
+        ADBLogAtExitSet = true;
+    }
+    __atomic_store_n(&ADBLogRunning, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ADBLogLock);
+    return 1;
+}
+
+/*
+** ADBLog::stop - Writes everything that is still queued, stops the
+**                background thread and goes back to logging directly.
+*/
+
+void ADBLog::stop()
+{
+    pthread_mutex_lock(&ADBLogLock);
+    if (!ADBLogRing) {
+        pthread_mutex_unlock(&ADBLogLock);
+        return;
+    }
+
+    if (!running()) {
+        // Someone else is already stopping it.
+        pthread_mutex_unlock(&ADBLogLock);
+        return;
+    }
+
+    // New messages go straight out from here on.  Wait for anyone who
+    // was already pushing to finish.  The drain thread needs the lock to
+    // make room for them, so don't hold it while we wait.
+    __atomic_store_n(&ADBLogRunning, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ADBLogLock);
+    while (__atomic_load_n(&ADBLogProducers, __ATOMIC_SEQ_CST)) sched_yield();
+
+    pthread_mutex_lock(&ADBLogLock);
+    ADBLogQuit = 1;
+    pthread_cond_signal(&ADBLogWake);
+    pthread_mutex_unlock(&ADBLogLock);
+    pthread_join(ADBLogThread, NULL);
+
+    pthread_mutex_lock(&ADBLogLock);
+    free(ADBLogRing);
+    ADBLogRing = NULL;
+    pthread_mutex_unlock(&ADBLogLock);
+}
+
+/*
+** ADBLog::running - Returns true if the asynchronous sink is running.
+*/
+
+bool ADBLog::running()
+{
+    return __atomic_load_n(&ADBLogRunning, __ATOMIC_RELAXED);
+}
+
+/*
+** ADBLog::setOverflowPolicy - Sets what happens when the ring is full,
+**                             ADB_LOG_DROP or ADB_LOG_BLOCK.
+*/
+
+void ADBLog::setOverflowPolicy(int newPolicy)
+{
+    ADBLogPolicy = newPolicy;
+}
+
+/*
+** ADBLog::push - Queues a message for the background thread.  Returns
+**                false if the sink isn't running, in which case the
+**                caller should write the message itself.  A message that
+**                is dropped because the ring is full counts as pushed.
+*/
+
+bool ADBLog::push(int priority, const char *msg)
+{
+    if (!running()) return false;
+    __atomic_add_fetch(&ADBLogProducers, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&ADBLogRunning, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&ADBLogProducers, 1, __ATOMIC_SEQ_CST);
+        return false;
+    }
+
+    ADBLogRecord *rec = NULL;
+    ulong pos = __atomic_load_n(&ADBLogEnqueue, __ATOMIC_RELAXED);
+    for (;;) {
+        rec = &ADBLogRing[pos & ADBLogMask];
+        ulong seq  = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        long  diff = (long) seq - (long) pos;
+        if (!diff) {
+            // The slot is free.  Try to claim it.
+            if (__atomic_compare_exchange_n(&ADBLogEnqueue, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            // The ring is full.
+            if (ADBLogPolicy != ADB_LOG_BLOCK) {
+                __atomic_add_fetch(&ADBLogDropped, 1, __ATOMIC_RELAXED);
+                __atomic_sub_fetch(&ADBLogProducers, 1, __ATOMIC_SEQ_CST);
+                return true;
+            }
+            sched_yield();
+            pos = __atomic_load_n(&ADBLogEnqueue, __ATOMIC_RELAXED);
+        } else {
+            // Someone else got it.
+            pos = __atomic_load_n(&ADBLogEnqueue, __ATOMIC_RELAXED);
+        }
+    }
+
+    rec->priority = priority;
+    strncpy(rec->msg, msg, ADB_LOGRECSIZE - 1);
+    rec->msg[ADB_LOGRECSIZE - 1] = '\0';
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&ADBLogProducers, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ADBLogSleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ADBLogLock);
+        pthread_cond_signal(&ADBLogWake);
+        pthread_mutex_unlock(&ADBLogLock);
+    }
+    return true;
+}
+
+/*
+** ADBLog::flush - Waits until every message queued before the call has
+**                 been written.
+*/
+
+void ADBLog::flush()
+{
+    if (!running()) return;
+
+    ulong target = __atomic_load_n(&ADBLogEnqueue, __ATOMIC_SEQ_CST);
+    while (running() && __atomic_load_n(&ADBLogWritten, __ATOMIC_ACQUIRE) < target) {
+        pthread_mutex_lock(&ADBLogLock);
+        pthread_cond_signal(&ADBLogWake);
+        pthread_mutex_unlock(&ADBLogLock);
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+/*
+** ADBLog::dropped - Returns the number of messages that were thrown away
+**                   because the ring was full.
+*/
+
+ulong ADBLog::dropped()
+{
+    return __atomic_load_n(&ADBLogDropped, __ATOMIC_RELAXED);
+}
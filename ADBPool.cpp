@@ -0,0 +1,537 @@
+/**
+ * ADBPool.cpp - A process-wide pool of MySQL connections shared by the
+ *               ADB, ADBTable and ADBList classes.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * Connections are grouped by host, user, password and database.  When an
+ * ADB object is created it borrows an idle connection from its group if
+ * one is available, otherwise it opens a new one.  When the object is
+ * destroyed the connection goes back to the idle list for the next caller.
+ *
+ * Idle connections that have not been used for a while are checked with
+ * mysql_ping() before they are handed out, and connections that sit idle
+ * past the idle timeout are closed, down to the configured minimum.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <ADB.h>
+#include <mysql/mysql.h>
+
+// A single pooled connection.
+struct ADBPoolConn
+{
+    MYSQL           *conn;
+    time_t          lastUsed;
+    ADBPoolConn     *next;
+};
+
+// A group of connections sharing the same connect information.
+struct ADBPoolKey
+{
+    char            *host;
+    char            *user;
+    char            *pass;
+    char            *name;
+    ADBPoolConn     *idle;
+    ADBPoolConn     *busy;
+    uint            idleCount;
+    uint            busyCount;
+    ADBPoolKey      *next;
+};
+
+static  pthread_mutex_t ADBPoolLock  = PTHREAD_MUTEX_INITIALIZER;
+static  pthread_cond_t  ADBPoolFreed = PTHREAD_COND_INITIALIZER;
+static  ADBPoolKey      *ADBPoolKeys = NULL;
+static  ADBPoolStats    ADBPoolCounters;
+
+static  bool    ADBPoolEnabled      = false;
+static  uint    ADBPoolMaxSize      = 0;        // Per key, 0 = no limit
+static  uint    ADBPoolMinIdle      = 0;        // Per key
+static  uint    ADBPoolIdleTimeout  = 300;      // Seconds
+static  uint    ADBPoolValidate     = 5;        // Seconds idle before a ping
+static  uint    ADBPoolWaitTimeout  = 10000;    // Milliseconds
+
+/*
+** ADBPoolStrEq - NULL safe string comparison for the key fields.
+*/
+
+static bool ADBPoolStrEq(const char *s1, const char *s2)
+{
+    if (!s1 || !s2) return s1 == s2;
+    return !strcmp(s1, s2);
+}
+
+/*
+** ADBPoolStrDup - NULL safe strdup.
+*/
+
+static char *ADBPoolStrDup(const char *src)
+{
+    if (!src) return NULL;
+    char *retVal = (char *) calloc(strlen(src)+1, sizeof(char));
+    strcpy(retVal, src);
+    return retVal;
+}
+
+/*
+** ADBPoolFindKey - Finds or creates the key entry for the connect info.
+**                  Must be called with ADBPoolLock held.
+*/
+
+static ADBPoolKey *ADBPoolFindKey(const char *Host, const char *User, const char *Pass, const char *Name)
+{
+    for (ADBPoolKey *key = ADBPoolKeys; key; key = key->next) {
+        if (ADBPoolStrEq(key->host, Host) && ADBPoolStrEq(key->user, User) &&
+            ADBPoolStrEq(key->pass, Pass) && ADBPoolStrEq(key->name, Name)) {
+            return key;
+        }
+    }
+
+    ADBPoolKey *key = (ADBPoolKey *) calloc(1, sizeof(ADBPoolKey));
+    key->host = ADBPoolStrDup(Host);
+    key->user = ADBPoolStrDup(User);
+    key->pass = ADBPoolStrDup(Pass);
+    key->name = ADBPoolStrDup(Name);
+    key->next = ADBPoolKeys;
+    ADBPoolKeys = key;
+    return key;
+}
+
+/*
+** ADBPoolConnect - Opens a brand new connection for the pool.  This is
+**                  called without ADBPoolLock held.
+*/
+
+static MYSQL *ADBPoolConnect(const char *Host, const char *User, const char *Pass, const char *Name)
+{
+    MYSQL   *conn = mysql_init(NULL);
+    if (!conn) {
+        ADBLogMsg(LOG_ERR, "ADBPool: mysql_init() failed, out of memory?");
+        return NULL;
+    }
+
+    ADBDebugMsg(1, "ADBPool: Connecting to %s as %s...", Host, User);
+    if (!mysql_real_connect(conn, Host, User, Pass, NULL, 0, NULL, 0)) {
+        ADBLogMsg(LOG_ERR, "ADBPool: Unable to connect to the database server on %s as %s.", Host, User);
+        mysql_close(conn);
+        return NULL;
+    }
+    if (mysql_select_db(conn, Name)) {
+        ADBLogMsg(LOG_ERR, "ADBPool: Unable to connect to database '%s'", Name);
+        mysql_close(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+/*
+** ADBPoolSweep - Detaches idle connections that have been idle for longer
+**                than the idle timeout, leaving at least ADBPoolMinIdle
+**                connections behind.  The detached connections are
+**                returned so the caller can close them after dropping the
+**                lock.  Must be called with ADBPoolLock held.
+*/
+
+static ADBPoolConn *ADBPoolSweep(ADBPoolKey *key, time_t now)
+{
+    ADBPoolConn *expired = NULL;
+    if (!ADBPoolIdleTimeout) return expired;
+
+    // The idle list is kept most recently used first, so the stale
+    // connections are always at the tail.
+    ADBPoolConn **prev = &key->idle;
+    uint        kept   = 0;
+    while (*prev) {
+        ADBPoolConn *pc = *prev;
+        if (kept >= ADBPoolMinIdle && (uint) (now - pc->lastUsed) >= ADBPoolIdleTimeout) {
+            *prev    = pc->next;
+            pc->next = expired;
+            expired  = pc;
+            key->idleCount--;
+            ADBPoolCounters.evictions++;
+        } else {
+            kept++;
+            prev = &pc->next;
+        }
+    }
+    return expired;
+}
+
+/*
+** ADBPoolCloseList - Closes and frees a list of detached connections.
+*/
+
+static void ADBPoolCloseList(ADBPoolConn *list)
+{
+    while (list) {
+        ADBPoolConn *next = list->next;
+        ADBStmtCache::dropConnection(list->conn);
+        mysql_close(list->conn);
+        free(list);
+        list = next;
+    }
+}
+
+/*
+** ADBPool::setEnabled - Turns pooling on or off for ADB objects created
+**                       from this point forward.
+*/
+
+void ADBPool::setEnabled(bool newVal)
+{
+    ADBPoolEnabled = newVal;
+}
+
+/*
+** ADBPool::enabled - Returns true if ADB objects borrow their connections
+**                    from the pool.
+*/
+
+bool ADBPool::enabled()
+{
+    return ADBPoolEnabled;
+}
+
+/*
+** ADBPool::setMaxSize - Sets the maximum number of connections (idle and
+**                       in use) per host/user/database.  0 is unlimited.
+*/
+
+void ADBPool::setMaxSize(uint newMax)
+{
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolMaxSize = newMax;
+    pthread_mutex_unlock(&ADBPoolLock);
+    pthread_cond_broadcast(&ADBPoolFreed);
+}
+
+/*
+** ADBPool::setMinIdle - Sets the number of idle connections per key that
+**                       are never evicted.
+*/
+
+void ADBPool::setMinIdle(uint newMin)
+{
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolMinIdle = newMin;
+    pthread_mutex_unlock(&ADBPoolLock);
+}
+
+/*
+** ADBPool::setIdleTimeout - Idle connections older than this many seconds
+**                           are closed.  0 disables eviction.
+*/
+
+void ADBPool::setIdleTimeout(uint secs)
+{
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolIdleTimeout = secs;
+    pthread_mutex_unlock(&ADBPoolLock);
+}
+
+/*
+** ADBPool::setValidateAfter - Connections that have been idle for at least
+**                             this many seconds are pinged before they are
+**                             handed out.  0 pings every time.
+*/
+
+void ADBPool::setValidateAfter(uint secs)
+{
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolValidate = secs;
+    pthread_mutex_unlock(&ADBPoolLock);
+}
+
+/*
+** ADBPool::setWaitTimeout - How long acquire() will wait for a connection
+**                           when the key is at its maximum size.
+*/
+
+void ADBPool::setWaitTimeout(uint msecs)
+{
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolWaitTimeout = msecs;
+    pthread_mutex_unlock(&ADBPoolLock);
+}
+
+/*
+** ADBPool::warmUp - Opens connections up front so the first ADB objects
+**                   created don't pay the connect cost.  Any of the connect
+**                   arguments that are NULL use the ADB defaults.
+**
+**                   Returns the number of idle connections for the key.
+*/
+
+int ADBPool::warmUp(uint count, const char *Name, const char *User, const char *Pass, const char *Host)
+{
+    if (!Name) Name = ADB::defaultDBase();
+    if (!User) User = ADB::defaultUser();
+    if (!Pass) Pass = ADB::defaultPass();
+    if (!Host) Host = ADB::defaultHost();
+
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolKey  *key = ADBPoolFindKey(Host, User, Pass, Name);
+    uint        need = 0;
+    if (key->idleCount < count) need = count - key->idleCount;
+    if (ADBPoolMaxSize && key->idleCount + key->busyCount + need > ADBPoolMaxSize) {
+        need = 0;
+        if (key->idleCount + key->busyCount < ADBPoolMaxSize) {
+            need = ADBPoolMaxSize - key->idleCount - key->busyCount;
+        }
+    }
+    pthread_mutex_unlock(&ADBPoolLock);
+
+    for (uint i = 0; i < need; i++) {
+        MYSQL *conn = ADBPoolConnect(Host, User, Pass, Name);
+        if (!conn) break;
+
+        ADBPoolConn *pc = (ADBPoolConn *) calloc(1, sizeof(ADBPoolConn));
+        pc->conn     = conn;
+        pc->lastUsed = time(NULL);
+
+        pthread_mutex_lock(&ADBPoolLock);
+        pc->next  = key->idle;
+        key->idle = pc;
+        key->idleCount++;
+        pthread_mutex_unlock(&ADBPoolLock);
+    }
+
+    pthread_mutex_lock(&ADBPoolLock);
+    int retVal = key->idleCount;
+    pthread_mutex_unlock(&ADBPoolLock);
+    pthread_cond_broadcast(&ADBPoolFreed);
+    return retVal;
+}
+
+/*
+** ADBPool::acquire - Borrows a connection for the given connect info,
+**                    opening a new one if no idle connection is available.
+**
+**                    Returns NULL if no connection could be made, or if the
+**                    key stayed at its maximum size for the wait timeout.
+*/
+
+MYSQL *ADBPool::acquire(const char *Host, const char *User, const char *Pass, const char *Name)
+{
+    MYSQL           *retVal = NULL;
+    struct timeval  waitStart;
+    bool            waited = false;
+
+    pthread_mutex_lock(&ADBPoolLock);
+    ADBPoolKey  *key = ADBPoolFindKey(Host, User, Pass, Name);
+
+    while (!retVal) {
+        time_t      now     = time(NULL);
+        ADBPoolConn *expired = ADBPoolSweep(key, now);
+
+        if (key->idle) {
+            // Take the most recently used connection, it is the least
+            // likely to have been dropped by the server.
+            ADBPoolConn *pc = key->idle;
+            key->idle = pc->next;
+            key->idleCount--;
+            bool needPing = (uint) (now - pc->lastUsed) >= ADBPoolValidate;
+            pc->next  = key->busy;
+            key->busy = pc;
+            key->busyCount++;
+            pthread_mutex_unlock(&ADBPoolLock);
+            ADBPoolCloseList(expired);
+
+            if (needPing && mysql_ping(pc->conn)) {
+                ADBLogMsg(LOG_WARNING, "ADBPool: Discarding dead connection to %s: %s", Host, mysql_error(pc->conn));
+                pthread_mutex_lock(&ADBPoolLock);
+                ADBPoolCounters.pingFailures++;
+                pthread_mutex_unlock(&ADBPoolLock);
+                release(pc->conn, false);
+                pthread_mutex_lock(&ADBPoolLock);
+                continue;
+            }
+
+            pthread_mutex_lock(&ADBPoolLock);
+            ADBPoolCounters.hits++;
+            retVal = pc->conn;
+            break;
+        }
+
+        if (!ADBPoolMaxSize || key->idleCount + key->busyCount < ADBPoolMaxSize) {
+            // Reserve the slot before we let go of the lock to connect.
+            key->busyCount++;
+            ADBPoolCounters.misses++;
+            pthread_mutex_unlock(&ADBPoolLock);
+            ADBPoolCloseList(expired);
+
+            MYSQL *conn = ADBPoolConnect(Host, User, Pass, Name);
+
+            pthread_mutex_lock(&ADBPoolLock);
+            if (!conn) {
+                key->busyCount--;
+                pthread_cond_broadcast(&ADBPoolFreed);
+                break;
+            }
+            ADBPoolConn *pc = (ADBPoolConn *) calloc(1, sizeof(ADBPoolConn));
+            pc->conn  = conn;
+            pc->next  = key->busy;
+            key->busy = pc;
+            retVal = conn;
+            break;
+        }
+
+        // We're at our maximum.  Wait for someone to give one back.
+        ADBPoolCloseList(expired);
+        if (!waited) {
+            waited = true;
+            gettimeofday(&waitStart, NULL);
+            ADBPoolCounters.waits++;
+        }
+        struct timespec deadline;
+        deadline.tv_sec  = waitStart.tv_sec + ADBPoolWaitTimeout / 1000;
+        deadline.tv_nsec = (waitStart.tv_usec + (ADBPoolWaitTimeout % 1000) * 1000) * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&ADBPoolFreed, &ADBPoolLock, &deadline) == ETIMEDOUT) {
+            ADBLogMsg(LOG_ERR, "ADBPool: Timed out waiting for a connection to %s (max %u)", Host, ADBPoolMaxSize);
+            break;
+        }
+    }
+
+    if (waited) {
+        struct timeval waitEnd;
+        gettimeofday(&waitEnd, NULL);
+        ADBPoolCounters.waitUSecs += (ullong) (waitEnd.tv_sec - waitStart.tv_sec) * 1000000 +
+                                     (waitEnd.tv_usec - waitStart.tv_usec);
+    }
+    pthread_mutex_unlock(&ADBPoolLock);
+    return retVal;
+}
+
+/*
+** ADBPool::release - Gives a connection back to the pool.  If reusable is
+**                    false the connection is closed instead of being
+**                    placed on the idle list.
+*/
+
+void ADBPool::release(MYSQL *conn, bool reusable)
+{
+    ADBPoolConn *found = NULL;
+    ADBPoolConn *expired = NULL;
+
+    pthread_mutex_lock(&ADBPoolLock);
+    for (ADBPoolKey *key = ADBPoolKeys; key && !found; key = key->next) {
+        for (ADBPoolConn **prev = &key->busy; *prev; prev = &(*prev)->next) {
+            if ((*prev)->conn != conn) continue;
+
+            found    = *prev;
+            *prev    = found->next;
+            key->busyCount--;
+            if (reusable) {
+                found->lastUsed = time(NULL);
+                found->next = key->idle;
+                key->idle   = found;
+                key->idleCount++;
+                expired = ADBPoolSweep(key, found->lastUsed);
+            } else {
+                found->next = NULL;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ADBPoolLock);
+    pthread_cond_broadcast(&ADBPoolFreed);
+
+    if (!found) {
+        ADBLogMsg(LOG_WARNING, "ADBPool::release() - Connection was not borrowed from the pool, closing it");
+        ADBStmtCache::dropConnection(conn);
+        mysql_close(conn);
+    } else if (!reusable) {
+        ADBPoolCloseList(found);
+    }
+    ADBPoolCloseList(expired);
+}
+
+/*
+** ADBPool::getStats - Copies the pool counters into the passed in struct.
+*/
+
+void ADBPool::getStats(ADBPoolStats *stats)
+{
+    if (!stats) return;
+    pthread_mutex_lock(&ADBPoolLock);
+    *stats = ADBPoolCounters;
+    stats->idle  = 0;
+    stats->inUse = 0;
+    for (ADBPoolKey *key = ADBPoolKeys; key; key = key->next) {
+        stats->idle  += key->idleCount;
+        stats->inUse += key->busyCount;
+    }
+    pthread_mutex_unlock(&ADBPoolLock);
+}
+
+/*
+** ADBPool::resetStats - Zeros the hit/miss/wait counters.
+*/
+
+void ADBPool::resetStats()
+{
+    pthread_mutex_lock(&ADBPoolLock);
+    memset(&ADBPoolCounters, 0, sizeof(ADBPoolCounters));
+    pthread_mutex_unlock(&ADBPoolLock);
+}
+
+/*
+** ADBPool::closeIdle - Closes every idle connection in the pool.  Useful
+**                      before a fork() or at program exit.
+*/
+
+void ADBPool::closeIdle()
+{
+    ADBPoolConn *closing = NULL;
+
+    pthread_mutex_lock(&ADBPoolLock);
+    for (ADBPoolKey *key = ADBPoolKeys; key; key = key->next) {
+        while (key->idle) {
+            ADBPoolConn *pc = key->idle;
+            key->idle = pc->next;
+            pc->next  = closing;
+            closing   = pc;
+        }
+        key->idleCount = 0;
+    }
+    pthread_mutex_unlock(&ADBPoolLock);
+
+    ADBPoolCloseList(closing);
+}
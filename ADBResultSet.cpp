@@ -0,0 +1,645 @@
+/**
+ * ADBResultSet.cpp - Query results stored a column at a time, with
+ *                    aggregate functions that run down the columns.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * The aggregates work 64 rows at a time, one word of the NULL and
+ * selection bitmaps.  When every row in a block counts, the inner loop is
+ * a plain walk down an array that the compiler can vectorize.  Otherwise
+ * only the rows whose bits are set are visited.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <ADB.h>
+#include <mysql/mysql.h>
+
+// The number of rows room is made for the first time.
+#define ADB_RS_MINROWS  1024
+
+struct ADBResultColumn
+{
+    char                name[ADB_MAXCOLWIDTH];
+    enum_field_types    type;
+    int                 kind;
+    llong               *ints;
+    double              *dbls;
+    ulong               *offsets;
+    ullong              *nulls;
+};
+
+/*
+** ADBStrToDouble - Converts a number to a double.  A plain decimal with
+**                  no more than 15 significant digits and 22 decimal
+**                  places is exact as an integer divided by a power of
+**                  ten, so that is done directly.  Everything else goes
+**                  to strtod().
+*/
+
+double ADBStrToDouble(const char *src, ulong len)
+{
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char  *pos = src;
+    const char  *end = src + len;
+    ullong      mantissa = 0;
+    int         digits = 0;
+    int         places = 0;
+    int         neg = 0;
+
+    if (pos < end && (*pos == '-' || *pos == '+')) neg = *pos++ == '-';
+    while (pos < end && (uint) (*pos - '0') <= 9) {
+        mantissa = mantissa * 10 + (*pos++ - '0');
+        digits++;
+    }
+    if (pos < end && *pos == '.') {
+        pos++;
+        while (pos < end && (uint) (*pos - '0') <= 9) {
+            mantissa = mantissa * 10 + (*pos++ - '0');
+            digits++;
+            places++;
+        }
+    }
+    if (pos != end || !digits || digits > 15 || places > 22) return strtod(src, NULL);
+
+    double  retVal = (double) mantissa / powers[places];
+    return neg ? -retVal : retVal;
+}
+
+/*
+** ADBStrToLLong - Converts an integer.  Anything that isn't a plain
+**                 integer that fits goes to strtoll().
+*/
+
+static inline llong ADBStrToLLong(const char *src, ulong len)
+{
+    const char  *pos = src;
+    const char  *end = src + len;
+    ullong      retVal = 0;
+    int         neg = 0;
+
+    if (pos < end && *pos == '-') neg = *pos++ == '-';
+    if (pos == end || end - pos > 18) return strtoll(src, NULL, 10);
+    while (pos < end) {
+        uint digit = (uint) (*pos++ - '0');
+        if (digit > 9) return strtoll(src, NULL, 10);
+        retVal = retVal * 10 + digit;
+    }
+    return neg ? -(llong) retVal : (llong) retVal;
+}
+
+/*
+** ADBResultKind - Picks how a column of a given type is stored.
+*/
+
+static int ADBResultKind(enum_field_types type)
+{
+    switch (type) {
+        case FIELD_TYPE_TINY:
+        case FIELD_TYPE_SHORT:
+        case FIELD_TYPE_LONG:
+        case FIELD_TYPE_LONGLONG:
+        case FIELD_TYPE_INT24:
+        case FIELD_TYPE_YEAR:
+            return ADB_RS_INT;
+
+        case FIELD_TYPE_FLOAT:
+        case FIELD_TYPE_DOUBLE:
+        case FIELD_TYPE_DECIMAL:
+        case MYSQL_TYPE_NEWDECIMAL:
+            return ADB_RS_DOUBLE;
+
+        case FIELD_TYPE_DATE:
+        case FIELD_TYPE_DATETIME:
+        case FIELD_TYPE_TIMESTAMP:
+            return ADB_RS_TIME;
+
+        default:
+            return ADB_RS_STRING;
+    }
+}
+
+/*
+** ADBBlockMask - Returns the rows of a 64 row block that count: not NULL,
+**                selected, and actually in the result.
+*/
+
+static inline ullong ADBBlockMask(const ullong *nulls, const ullong *selection, ulong word, ulong rows)
+{
+    ullong  mask = ~nulls[word];
+    if (selection) mask &= selection[word];
+    ulong   left = rows - word * 64;
+    if (left < 64) mask &= (1ULL << left) - 1;
+    return mask;
+}
+
+/*
+** ADBSumBlocks - Adds up the rows of a column picked by the masks.
+*/
+
+template <class T, class S>
+static S ADBSumBlocks(const T *vals, const ullong *nulls, const ullong *selection, ulong rows)
+{
+    S       acc[4] = { 0, 0, 0, 0 };
+    ulong   words  = (rows + 63) / 64;
+
+    for (ulong w = 0; w < words; w++) {
+        ullong  mask = ADBBlockMask(nulls, selection, w, rows);
+        const T *v   = vals + w * 64;
+        if (mask == ~0ULL) {
+            // Four running totals so the additions don't wait on each other.
+            for (int i = 0; i < 64; i += 4) {
+                acc[0] += v[i];
+                acc[1] += v[i + 1];
+                acc[2] += v[i + 2];
+                acc[3] += v[i + 3];
+            }
+        } else {
+            while (mask) {
+                acc[0] += v[__builtin_ctzll(mask)];
+                mask   &= mask - 1;
+            }
+        }
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+/*
+** ADBMinMaxBlocks - Finds the smallest or largest of the rows of a column
+**                   picked by the masks.  Returns false if there were none.
+*/
+
+template <class T>
+static bool ADBMinMaxBlocks(const T *vals, const ullong *nulls, const ullong *selection, ulong rows, bool wantMax, T *result)
+{
+    ulong   words = (rows + 63) / 64;
+    bool    found = false;
+    T       best  = 0;
+
+    for (ulong w = 0; w < words; w++) {
+        ullong  mask = ADBBlockMask(nulls, selection, w, rows);
+        const T *v   = vals + w * 64;
+        if (!mask) continue;
+        if (!found) {
+            best  = v[__builtin_ctzll(mask)];
+            found = true;
+        }
+        if (mask == ~0ULL) {
+            T   blockBest = v[0];
+            if (wantMax) {
+                for (int i = 1; i < 64; i++) blockBest = v[i] > blockBest ? v[i] : blockBest;
+                best = blockBest > best ? blockBest : best;
+            } else {
+                for (int i = 1; i < 64; i++) blockBest = v[i] < blockBest ? v[i] : blockBest;
+                best = blockBest < best ? blockBest : best;
+            }
+        } else {
+            while (mask) {
+                T val = v[__builtin_ctzll(mask)];
+                if (wantMax ? val > best : val < best) best = val;
+                mask &= mask - 1;
+            }
+        }
+    }
+    *result = best;
+    return found;
+}
+
+/*
+** ADBFilterBlocks - Clears the selection bits of the rows that don't
+**                   compare with value.  Returns the rows left selected.
+*/
+
+#define ADB_RS_COMPARE(expr) \
+    for (ulong i = 0; i < n; i++) bits |= (ullong) (expr) << i
+
+template <class T>
+static ulong ADBFilterBlocks(const T *vals, const ullong *nulls, ulong rows, int op, double value, ullong *selection)
+{
+    ulong   words  = (rows + 63) / 64;
+    ulong   retVal = 0;
+
+    for (ulong w = 0; w < words; w++) {
+        const T *v    = vals + w * 64;
+        ulong   n     = rows - w * 64 < 64 ? rows - w * 64 : 64;
+        ullong  bits  = 0;
+        switch (op) {
+            case ADB_RS_EQ: ADB_RS_COMPARE(v[i] == value); break;
+            case ADB_RS_NE: ADB_RS_COMPARE(v[i] != value); break;
+            case ADB_RS_LT: ADB_RS_COMPARE(v[i] <  value); break;
+            case ADB_RS_LE: ADB_RS_COMPARE(v[i] <= value); break;
+            case ADB_RS_GT: ADB_RS_COMPARE(v[i] >  value); break;
+            case ADB_RS_GE: ADB_RS_COMPARE(v[i] >= value); break;
+        }
+        selection[w] &= bits & ~nulls[w];
+        retVal += __builtin_popcountll(selection[w]);
+    }
+    return retVal;
+}
+
+/*
+** ADBResultSet::ADBResultSet - Creates an empty result set.
+*/
+
+ADBResultSet::ADBResultSet()
+{
+    cols    = NULL;
+    numCols = 0;
+    rows    = 0;
+    rowSize = 0;
+    strData = NULL;
+    strLen  = 0;
+    strSize = 0;
+}
+
+/*
+** ADBResultSet::~ADBResultSet - Frees everything.
+*/
+
+ADBResultSet::~ADBResultSet()
+{
+    clear();
+}
+
+/*
+** ADBResultSet::clear - Throws away the columns and rows.
+*/
+
+void ADBResultSet::clear()
+{
+    for (uint i = 0; i < numCols; i++) {
+        free(cols[i].ints);
+        free(cols[i].dbls);
+        free(cols[i].offsets);
+        free(cols[i].nulls);
+    }
+    free(cols);
+    free(strData);
+    cols    = NULL;
+    numCols = 0;
+    rows    = 0;
+    rowSize = 0;
+    strData = NULL;
+    strLen  = 0;
+    strSize = 0;
+    colIndex.clear();
+}
+
+/*
+** ADBResultSet::grow - Makes room in every column for at least minRows.
+*/
+
+void ADBResultSet::grow(ulong minRows)
+{
+    ulong   newSize = rowSize ? rowSize : ADB_RS_MINROWS;
+    while (newSize < minRows) newSize *= 2;
+    if (newSize == rowSize) return;
+
+    ulong   oldWords = (rowSize + 63) / 64;
+    ulong   newWords = (newSize + 63) / 64;
+    for (uint i = 0; i < numCols; i++) {
+        ADBResultColumn *col = &cols[i];
+        if (col->kind == ADB_RS_DOUBLE) {
+            col->dbls = (double *) realloc(col->dbls, newSize * sizeof(double));
+        } else if (col->kind == ADB_RS_STRING) {
+            col->offsets = (ulong *) realloc(col->offsets, newSize * sizeof(ulong));
+        } else {
+            col->ints = (llong *) realloc(col->ints, newSize * sizeof(llong));
+        }
+        col->nulls = (ullong *) realloc(col->nulls, newWords * sizeof(ullong));
+        memset(col->nulls + oldWords, 0, (newWords - oldWords) * sizeof(ullong));
+    }
+    rowSize = newSize;
+}
+
+/*
+** ADBResultSet::addString - Appends a string to the string buffer and
+**                           records where it went for the current row.
+*/
+
+void ADBResultSet::addString(ADBResultColumn *col, const char *src, ulong len)
+{
+    if (strLen + len + 1 > strSize) {
+        ulong newSize = strSize ? strSize : 65536;
+        while (newSize < strLen + len + 1) newSize *= 2;
+        strData = (char *) realloc(strData, newSize);
+        strSize = newSize;
+    }
+    col->offsets[rows] = strLen;
+    memcpy(strData + strLen, src, len);
+    strData[strLen + len] = '\0';
+    strLen += len + 1;
+}
+
+/*
+** ADBResultSet::load - Reads every row of a result into the columns,
+**                      replacing whatever was there.  The result may be
+**                      from mysql_store_result() or mysql_use_result().
+**
+**                      Returns the number of rows loaded.
+*/
+
+long ADBResultSet::load(MYSQL_RES *res)
+{
+    clear();
+    if (!res) return 0;
+
+    numCols = mysql_num_fields(res);
+    if (numCols > ADB_MAXCOLS) numCols = ADB_MAXCOLS;
+    cols = (ADBResultColumn *) calloc(numCols ? numCols : 1, sizeof(ADBResultColumn));
+
+    MYSQL_FIELD *fields = mysql_fetch_fields(res);
+    for (uint i = 0; i < numCols; i++) {
+        strncpy(cols[i].name, fields[i].name, ADB_MAXCOLWIDTH - 1);
+        cols[i].type = fields[i].type;
+        cols[i].kind = ADBResultKind(fields[i].type);
+        colIndex.add(cols[i].name, i);
+    }
+
+    MYSQL_ROW   row;
+    while ((row = mysql_fetch_row(res))) {
+        ulong *lengths = mysql_fetch_lengths(res);
+        if (rows >= rowSize) grow(rows + 1);
+
+        for (uint i = 0; i < numCols; i++) {
+            ADBResultColumn *col = &cols[i];
+            const char      *val = row[i];
+            if (!val) col->nulls[rows / 64] |= 1ULL << (rows % 64);
+
+            switch (col->kind) {
+                case ADB_RS_INT:
+                    col->ints[rows] = val ? ADBStrToLLong(val, lengths[i]) : 0;
+                break;
+
+                case ADB_RS_DOUBLE:
+                    col->dbls[rows] = val ? ADBStrToDouble(val, lengths[i]) : 0.0;
+                break;
+
+                case ADB_RS_TIME:
+                    col->ints[rows] = val ? ADBDateTimeToEpoch(val, lengths[i]) : 0;
+                break;
+
+                default:
+                    addString(col, val ? val : "", val ? lengths[i] : 0);
+                break;
+            }
+        }
+        rows++;
+    }
+
+    ADBDebugMsg(1, "ADBResultSet: loaded %ld rows of %d columns", rows, numCols);
+    return rows;
+}
+
+/*
+** ADBResultSet::numRows - Returns the number of rows loaded.
+*/
+
+ulong ADBResultSet::numRows()
+{
+    return rows;
+}
+
+/*
+** ADBResultSet::numColumns - Returns the number of columns loaded.
+*/
+
+uint ADBResultSet::numColumns()
+{
+    return numCols;
+}
+
+/*
+** ADBResultSet::columnName - Returns the name of a column.
+*/
+
+const char *ADBResultSet::columnName(uint colNo)
+{
+    return colNo < numCols ? cols[colNo].name : "";
+}
+
+/*
+** ADBResultSet::columnNumber - Returns the number of a column, or
+**                              ADB_MAXCOLS if there is no such column.
+*/
+
+uint ADBResultSet::columnNumber(const char *colName)
+{
+    return colIndex.find(colName);
+}
+
+/*
+** ADBResultSet::columnKind - Returns how a column is stored, one of the
+**                            ADB_RS_ kinds, or 0 for no such column.
+*/
+
+int ADBResultSet::columnKind(uint colNo)
+{
+    return colNo < numCols ? cols[colNo].kind : 0;
+}
+
+/*
+** ADBResultSet::ints - Returns the values of an integer or date column.
+*/
+
+const llong *ADBResultSet::ints(uint colNo)
+{
+    return colNo < numCols ? cols[colNo].ints : NULL;
+}
+
+/*
+** ADBResultSet::doubles - Returns the values of a floating point column.
+*/
+
+const double *ADBResultSet::doubles(uint colNo)
+{
+    return colNo < numCols ? cols[colNo].dbls : NULL;
+}
+
+/*
+** ADBResultSet::nulls - Returns the NULL bitmap of a column.
+*/
+
+const ullong *ADBResultSet::nulls(uint colNo)
+{
+    return colNo < numCols ? cols[colNo].nulls : NULL;
+}
+
+/*
+** ADBResultSet::str - Returns a value of a string column.  NULLs come back
+**                     as empty strings.
+*/
+
+const char *ADBResultSet::str(uint colNo, ulong rowNo)
+{
+    if (colNo >= numCols || rowNo >= rows || cols[colNo].kind != ADB_RS_STRING) return "";
+    return strData + cols[colNo].offsets[rowNo];
+}
+
+/*
+** ADBResultSet::isNull - Returns true if a value is NULL.
+*/
+
+bool ADBResultSet::isNull(uint colNo, ulong rowNo)
+{
+    if (colNo >= numCols || rowNo >= rows) return true;
+    return (cols[colNo].nulls[rowNo / 64] >> (rowNo % 64)) & 1;
+}
+
+/*
+** ADBResultSet::selectionWords - Returns the number of 64 bit words a
+**                                selection bitmap needs.
+*/
+
+ulong ADBResultSet::selectionWords()
+{
+    return (rows + 63) / 64;
+}
+
+/*
+** ADBResultSet::selectAll - Sets a selection to every row.
+*/
+
+void ADBResultSet::selectAll(ullong *selection)
+{
+    ulong   words = selectionWords();
+    if (!words) return;
+    memset(selection, 0xff, words * sizeof(ullong));
+    if (rows % 64) selection[words - 1] = (1ULL << (rows % 64)) - 1;
+}
+
+/*
+** ADBResultSet::numericColumn - Returns a column if it can be used by the
+**                               aggregates, logging a warning if not.
+*/
+
+ADBResultColumn *ADBResultSet::numericColumn(uint colNo, const char *caller)
+{
+    if (colNo >= numCols) {
+        ADBLogMsg(LOG_WARNING, "ADBResultSet::%s - Column %d is out of range", caller, colNo);
+        return NULL;
+    }
+    if (cols[colNo].kind == ADB_RS_STRING) {
+        ADBLogMsg(LOG_WARNING, "ADBResultSet::%s - Column '%s' is not numeric", caller, cols[colNo].name);
+        return NULL;
+    }
+    return &cols[colNo];
+}
+
+/*
+** ADBResultSet::filter - Removes the rows from selection whose values in
+**                        colNo don't compare with value.  NULLs never
+**                        match.  Returns the number of rows still selected.
+*/
+
+ulong ADBResultSet::filter(uint colNo, int op, double value, ullong *selection)
+{
+    ADBResultColumn *col = numericColumn(colNo, "filter()");
+    if (!col || !rows) return 0;
+    if (col->kind == ADB_RS_DOUBLE) return ADBFilterBlocks(col->dbls, col->nulls, rows, op, value, selection);
+    return ADBFilterBlocks(col->ints, col->nulls, rows, op, value, selection);
+}
+
+/*
+** ADBResultSet::count - Returns the number of non-NULL values in a column.
+*/
+
+ulong ADBResultSet::count(uint colNo, const ullong *selection)
+{
+    ulong   retVal = 0;
+    if (colNo >= numCols) return retVal;
+
+    ulong   words = selectionWords();
+    for (ulong w = 0; w < words; w++) {
+        retVal += __builtin_popcountll(ADBBlockMask(cols[colNo].nulls, selection, w, rows));
+    }
+    return retVal;
+}
+
+/*
+** ADBResultSet::sum - Returns the total of a column.
+*/
+
+double ADBResultSet::sum(uint colNo, const ullong *selection)
+{
+    ADBResultColumn *col = numericColumn(colNo, "sum()");
+    if (!col || !rows) return 0.0;
+    if (col->kind == ADB_RS_DOUBLE) return ADBSumBlocks<double, double>(col->dbls, col->nulls, selection, rows);
+    return (double) ADBSumBlocks<llong, llong>(col->ints, col->nulls, selection, rows);
+}
+
+/*
+** ADBResultSet::sumInt - Returns the total of an integer column, exactly.
+*/
+
+llong ADBResultSet::sumInt(uint colNo, const ullong *selection)
+{
+    ADBResultColumn *col = numericColumn(colNo, "sumInt()");
+    if (!col || !rows) return 0;
+    if (col->kind == ADB_RS_DOUBLE) return (llong) ADBSumBlocks<double, double>(col->dbls, col->nulls, selection, rows);
+    return ADBSumBlocks<llong, llong>(col->ints, col->nulls, selection, rows);
+}
+
+/*
+** ADBResultSet::min - Returns the smallest value in a column, or 0 if
+**                     there are no values.
+*/
+
+double ADBResultSet::min(uint colNo, const ullong *selection)
+{
+    ADBResultColumn *col = numericColumn(colNo, "min()");
+    if (!col || !rows) return 0.0;
+    if (col->kind == ADB_RS_DOUBLE) {
+        double  retVal;
+        return ADBMinMaxBlocks(col->dbls, col->nulls, selection, rows, false, &retVal) ? retVal : 0.0;
+    }
+    llong   retVal;
+    return ADBMinMaxBlocks(col->ints, col->nulls, selection, rows, false, &retVal) ? (double) retVal : 0.0;
+}
+
+/*
+** ADBResultSet::max - Returns the largest value in a column, or 0 if
+**                     there are no values.
+*/
+
+double ADBResultSet::max(uint colNo, const ullong *selection)
+{
+    ADBResultColumn *col = numericColumn(colNo, "max()");
+    if (!col || !rows) return 0.0;
+    if (col->kind == ADB_RS_DOUBLE) {
+        double  retVal;
+        return ADBMinMaxBlocks(col->dbls, col->nulls, selection, rows, true, &retVal) ? retVal : 0.0;
+    }
+    llong   retVal;
+    return ADBMinMaxBlocks(col->ints, col->nulls, selection, rows, true, &retVal) ? (double) retVal : 0.0;
+}
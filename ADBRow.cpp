@@ -43,6 +43,8 @@ ADBRow::ADBRow()
     numFields       = 0;
     debugLevel      = 0;
     zeroDatesAsNULL = false;
+    zeroCopy        = false;
+    rowRes          = NULL;
 }
 
 /*
@@ -73,6 +75,15 @@ void ADBRow::setZeroDatesAsNULL(bool newValue)
     zeroDatesAsNULL = newValue;
 }
 
+/*
+** ADBRow::setZeroCopy - Turns zero copy row loading on or off.
+*/
+
+void ADBRow::setZeroCopy(bool newValue)
+{
+    zeroCopy = newValue;
+}
+
 /*
 ** ADBRow::clearRow() - Clears all of the variables we currently have defined
 **                  in preparation for the retrieval of a new row.
@@ -85,6 +96,8 @@ void ADBRow::clearRow()
     }
     numFields       = 0;
     intRowDefined   = 0;
+    rowRes          = NULL;
+    colIndex.clear();
 
 }
 
@@ -100,11 +113,48 @@ int ADBRow::loadRow(MYSQL_RES *queryRes)
     unsigned long   *rowLengths;
     MYSQL_FIELD     *curField;
 
+    if (zeroCopy) {
+        rawRow = mysql_fetch_row(queryRes);
+        if (!rawRow) {
+            // Whatever we were pointing at may be gone.
+            for (uint i = 0; i < numFields; i++) columns[i]->view(NULL, 0);
+            return ret;
+        }
+        rowLengths = (unsigned long *) mysql_fetch_lengths(queryRes);
+
+        // The column definitions only need to be set up once per result.
+        // A new result may be given the address of the one before it, so
+        // the field count is checked as well.
+        if (!intRowDefined || rowRes != queryRes || mysql_num_fields(queryRes) != numFields) {
+            clearRow();
+            numFields = mysql_num_fields(queryRes);
+            MYSQL_FIELD *fields = mysql_fetch_fields(queryRes);
+            for (uint i = 0; i < numFields; i++) {
+                columns[i] = new ADBColumn();
+                columns[i]->setDebugLevel(debugLevel);
+                columns[i]->define(i, &fields[i]);
+            }
+            buildIndex();
+            intRowDefined = 1;
+            rowRes        = queryRes;
+        }
+
+        for (uint i = 0; i < numFields; i++) columns[i]->view(rawRow[i], rowLengths[i]);
+        return 1;
+    }
+
     ADBDebugMsg(7, "ADBRow::loadRow clearing currently loaded data...");
     // clearRow();
 
     ADBDebugMsg(7, "ADBRow::loadRow determining field count...");
-    numFields = mysql_num_fields(queryRes);
+    uint    resFields = mysql_num_fields(queryRes);
+
+    // The columns are redefined in place below, which can rename them, so
+    // the name index is rebuilt if this is a different result.  If the
+    // number of columns changed, start over.
+    if (intRowDefined && resFields != numFields) clearRow();
+    int     newResult = !intRowDefined || rowRes != queryRes;
+    numFields = resFields;
     
     // Now that we have the number of fields, we can proceed.
     if (numFields > 0) {
@@ -124,7 +174,9 @@ int ADBRow::loadRow(MYSQL_RES *queryRes)
                 columns[i]->setDebugLevel(debugLevel);
                 columns[i]->define(i, curField, rawRow[i]);
             }
+            if (newResult) buildIndex();
             intRowDefined = 1;
+            rowRes        = queryRes;
             ret = 1;
         }
     }
@@ -279,7 +331,7 @@ ADBColumn *ADBRow::primaryKey()
 ADBColumn *ADBRow::findColumn(unsigned int colNo)
 {
     ADBColumn   *retVal = NULL;
-    if (intRowDefined && numFields && (colNo <= numFields)) {
+    if (intRowDefined && numFields && (colNo < numFields)) {
         retVal = columns[colNo];
     }
     return retVal;
@@ -293,15 +345,26 @@ ADBColumn *ADBRow::findColumn(const char *colName)
 {
     ADBColumn   *retVal = NULL;
     if (intRowDefined && numFields) {
-        for (uint i = 0; i < numFields; i++) {
-            if (!strcmp(colName, columns[i]->ColumnName())) {
-                retVal = columns[i];
-            }
-        }
+        uint colNo = colIndex.find(colName);
+        if (colNo < numFields) retVal = columns[colNo];
     }
     return retVal;
 }
 
+/*
+** buildIndex   - Indexes the column names of the current result.  When
+**                a name appears more than once, as in a join, the last
+**                column with that name is the one found.
+*/
+
+void ADBRow::buildIndex()
+{
+    colIndex.clear();
+    for (uint i = numFields; i > 0; i--) {
+        colIndex.add(columns[i - 1]->ColumnName(), i - 1);
+    }
+}
+
 
 
 
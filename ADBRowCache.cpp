@@ -0,0 +1,550 @@
+/**
+ * ADBRowCache.cpp - A process-wide cache of rows loaded by ADBTable::get().
+ *                   Opt-in, per table, keyed by primary key.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * Each table that has been enabled gets a hash of its cached rows and a
+ * doubly linked list of them in the order they were used, most recent
+ * first.  A row is kept as the server sent it, the column strings one
+ * after the other, so ADBTable loads it (and decrypts it) exactly as it
+ * would a row from the server.  A key the server didn't have is kept as a
+ * row with no data.
+ *
+ * Everything is under a single mutex, which is never held while talking
+ * to the server.  Programs that never enable a table don't take it.
+ *
+ * Because the lock isn't held while a row is read from the server, a
+ * write can be sent and its key invalidated between the read and the
+ * store of the old row.  Each table has a generation that every
+ * invalidation changes.  fetch() hands the caller the generation on a
+ * miss, and store() drops the row if it has changed since.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <pthread.h>
+#include <ADB.h>
+
+// A cached row, or a cached miss if data is NULL.
+struct ADBRowCacheEntry
+{
+    long                key;
+    time_t              expires;
+    uint                numCols;
+    char                *data;
+    ulong               dataLen;
+    ADBRowCacheEntry    *hashNext;
+    ADBRowCacheEntry    *lruPrev;
+    ADBRowCacheEntry    *lruNext;
+};
+
+// The cache for a single table.
+struct ADBRowCacheTable
+{
+    char                *host;
+    char                *name;
+    char                *table;
+    ulong               maxRows;
+    uint                ttlSecs;
+    uint                negTtlSecs;
+    ADBRowCacheEntry    **buckets;
+    ulong               numBuckets;
+    ADBRowCacheEntry    *lruHead;
+    ADBRowCacheEntry    *lruTail;
+    ADBRowCacheStats    counters;
+    ullong              generation;
+    ADBRowCacheTable    *next;
+};
+
+static  pthread_mutex_t     ADBRowCacheLock   = PTHREAD_MUTEX_INITIALIZER;
+static  ADBRowCacheTable    *ADBRowCacheTables = NULL;
+
+// The number of tables enabled.  Read without the lock so get() on a
+// table that isn't cached costs a compare.
+static  volatile int        ADBRowCacheActive = 0;
+
+// Where table generations come from.  Shared by all tables so a table
+// that is disabled and enabled again never reuses one.
+static  ullong              ADBRowCacheGenSeq = 0;
+
+/*
+** ADBRowCacheStrDup - A strdup() that uses calloc like the rest of ADB.
+*/
+
+static char *ADBRowCacheStrDup(const char *src)
+{
+    char *retVal = (char *) calloc(strlen(src)+1, sizeof(char));
+    strcpy(retVal, src);
+    return retVal;
+}
+
+/*
+** ADBRowCacheFind - Finds the cache for a table.  The caller must hold
+**                   the lock.
+*/
+
+static ADBRowCacheTable *ADBRowCacheFind(const char *Host, const char *Name, const char *Table)
+{
+    if (!Host || !Name || !Table) return NULL;
+    for (ADBRowCacheTable *t = ADBRowCacheTables; t; t = t->next) {
+        if (!strcmp(t->table, Table) && !strcmp(t->name, Name) && !strcmp(t->host, Host)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*
+** ADBRowCacheBucket - Returns the hash bucket for a key.
+*/
+
+static ADBRowCacheEntry **ADBRowCacheBucket(ADBRowCacheTable *t, long keyVal)
+{
+    ullong h = (ullong) keyVal * 0x9E3779B97F4A7C15ULL;
+    return &t->buckets[(h >> 32) & (t->numBuckets - 1)];
+}
+
+/*
+** ADBRowCacheLookup - Finds the entry for a key, or NULL.
+*/
+
+static ADBRowCacheEntry *ADBRowCacheLookup(ADBRowCacheTable *t, long keyVal)
+{
+    for (ADBRowCacheEntry *e = *ADBRowCacheBucket(t, keyVal); e; e = e->hashNext) {
+        if (e->key == keyVal) return e;
+    }
+    return NULL;
+}
+
+/*
+** ADBRowCacheUnlink - Takes an entry off the LRU list.
+*/
+
+static void ADBRowCacheUnlink(ADBRowCacheTable *t, ADBRowCacheEntry *e)
+{
+    if (e->lruPrev) e->lruPrev->lruNext = e->lruNext;
+    else t->lruHead = e->lruNext;
+    if (e->lruNext) e->lruNext->lruPrev = e->lruPrev;
+    else t->lruTail = e->lruPrev;
+    e->lruPrev = NULL;
+    e->lruNext = NULL;
+}
+
+/*
+** ADBRowCachePushFront - Puts an entry at the most recently used end.
+*/
+
+static void ADBRowCachePushFront(ADBRowCacheTable *t, ADBRowCacheEntry *e)
+{
+    e->lruPrev = NULL;
+    e->lruNext = t->lruHead;
+    if (t->lruHead) t->lruHead->lruPrev = e;
+    else t->lruTail = e;
+    t->lruHead = e;
+}
+
+/*
+** ADBRowCacheRemove - Drops an entry from the cache and frees it.
+*/
+
+static void ADBRowCacheRemove(ADBRowCacheTable *t, ADBRowCacheEntry *e)
+{
+    for (ADBRowCacheEntry **prev = ADBRowCacheBucket(t, e->key); *prev; prev = &(*prev)->hashNext) {
+        if (*prev == e) {
+            *prev = e->hashNext;
+            break;
+        }
+    }
+    ADBRowCacheUnlink(t, e);
+    free(e->data);
+    free(e);
+    t->counters.rows--;
+}
+
+/*
+** ADBRowCacheInsert - Adds an entry for a key, replacing any there is
+**                     already, and evicts the least recently used rows if
+**                     the table is over its limit.  data is taken over.
+*/
+
+static void ADBRowCacheInsert(ADBRowCacheTable *t, long keyVal, uint numCols, char *data, ulong dataLen, uint ttlSecs)
+{
+    ADBRowCacheEntry *e = ADBRowCacheLookup(t, keyVal);
+    if (e) ADBRowCacheRemove(t, e);
+
+    e = (ADBRowCacheEntry *) calloc(1, sizeof(ADBRowCacheEntry));
+    e->key      = keyVal;
+    e->expires  = ttlSecs ? time(NULL) + ttlSecs : 0;
+    e->numCols  = numCols;
+    e->data     = data;
+    e->dataLen  = dataLen;
+
+    ADBRowCacheEntry **bucket = ADBRowCacheBucket(t, keyVal);
+    e->hashNext = *bucket;
+    *bucket     = e;
+    ADBRowCachePushFront(t, e);
+    t->counters.rows++;
+
+    while (t->counters.rows > t->maxRows && t->lruTail) {
+        ADBRowCacheRemove(t, t->lruTail);
+        t->counters.evictions++;
+    }
+}
+
+/*
+** ADBRowCacheEmpty - Drops every entry for a table.
+*/
+
+static void ADBRowCacheEmpty(ADBRowCacheTable *t)
+{
+    while (t->lruHead) ADBRowCacheRemove(t, t->lruHead);
+    t->generation = ++ADBRowCacheGenSeq;
+}
+
+/*
+** ADBRowCache::enable - Turns on caching for a table, or changes its
+**                       limits.  Changing the limits empties the cache.
+**                       maxRows must be at least 1.
+**
+**                       Returns 1 if successful.
+*/
+
+int ADBRowCache::enable(const char *Host, const char *Name, const char *Table, ulong maxRows, uint ttlSecs, uint negTtlSecs)
+{
+    if (!Host) Host = ADB::defaultHost();
+    if (!Name) Name = ADB::defaultDBase();
+    if (!Host || !Name || !Table || !maxRows) return 0;
+
+    // Keep the chains short, at about one row per bucket when full.
+    ulong   numBuckets = 16;
+    while (numBuckets < maxRows && numBuckets < (1UL << 24)) numBuckets <<= 1;
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t) {
+        ADBRowCacheEmpty(t);
+        free(t->buckets);
+    } else {
+        t = (ADBRowCacheTable *) calloc(1, sizeof(ADBRowCacheTable));
+        t->host  = ADBRowCacheStrDup(Host);
+        t->name  = ADBRowCacheStrDup(Name);
+        t->table = ADBRowCacheStrDup(Table);
+        t->next  = ADBRowCacheTables;
+        t->generation = ++ADBRowCacheGenSeq;
+        ADBRowCacheTables = t;
+        ADBRowCacheActive++;
+    }
+    t->maxRows    = maxRows;
+    t->ttlSecs    = ttlSecs;
+    t->negTtlSecs = negTtlSecs;
+    t->numBuckets = numBuckets;
+    t->buckets    = (ADBRowCacheEntry **) calloc(numBuckets, sizeof(ADBRowCacheEntry *));
+    pthread_mutex_unlock(&ADBRowCacheLock);
+
+    ADBDebugMsg(1, "ADBRowCache::enable() - Caching up to %lu rows of '%s'", maxRows, Table);
+    return 1;
+}
+
+/*
+** ADBRowCache::disable - Turns off caching for a table and frees its rows.
+*/
+
+void ADBRowCache::disable(const char *Host, const char *Name, const char *Table)
+{
+    if (!Host) Host = ADB::defaultHost();
+    if (!Name) Name = ADB::defaultDBase();
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    for (ADBRowCacheTable **prev = &ADBRowCacheTables; *prev; prev = &(*prev)->next) {
+        ADBRowCacheTable *t = *prev;
+        if (Host && Name && Table && !strcmp(t->table, Table) && !strcmp(t->name, Name) && !strcmp(t->host, Host)) {
+            *prev = t->next;
+            ADBRowCacheEmpty(t);
+            free(t->buckets);
+            free(t->host);
+            free(t->name);
+            free(t->table);
+            free(t);
+            ADBRowCacheActive--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
+
+/*
+** ADBRowCache::clear - Drops every cached row.  The tables stay enabled.
+*/
+
+void ADBRowCache::clear()
+{
+    pthread_mutex_lock(&ADBRowCacheLock);
+    for (ADBRowCacheTable *t = ADBRowCacheTables; t; t = t->next) ADBRowCacheEmpty(t);
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
+
+/*
+** ADBRowCache::getStats - Copies the counters, totalled over all tables,
+**                         into the passed in struct.
+*/
+
+void ADBRowCache::getStats(ADBRowCacheStats *stats)
+{
+    if (!stats) return;
+    memset(stats, 0, sizeof(ADBRowCacheStats));
+    pthread_mutex_lock(&ADBRowCacheLock);
+    for (ADBRowCacheTable *t = ADBRowCacheTables; t; t = t->next) {
+        stats->hits          += t->counters.hits;
+        stats->negativeHits  += t->counters.negativeHits;
+        stats->misses        += t->counters.misses;
+        stats->evictions     += t->counters.evictions;
+        stats->expirations   += t->counters.expirations;
+        stats->invalidations += t->counters.invalidations;
+        stats->rows          += t->counters.rows;
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
+
+/*
+** ADBRowCache::getTableStats - Copies the counters for a single table into
+**                              the passed in struct.
+**
+**                              Returns 0 if the table isn't cached.
+*/
+
+int ADBRowCache::getTableStats(const char *Host, const char *Name, const char *Table, ADBRowCacheStats *stats)
+{
+    int     retVal = 0;
+    if (!Host) Host = ADB::defaultHost();
+    if (!Name) Name = ADB::defaultDBase();
+    if (!stats) return retVal;
+
+    memset(stats, 0, sizeof(ADBRowCacheStats));
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t) {
+        *stats = t->counters;
+        retVal = 1;
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+    return retVal;
+}
+
+/*
+** ADBRowCache::resetStats - Zeros the counters, except for the number of
+**                           rows cached.
+*/
+
+void ADBRowCache::resetStats()
+{
+    pthread_mutex_lock(&ADBRowCacheLock);
+    for (ADBRowCacheTable *t = ADBRowCacheTables; t; t = t->next) {
+        ulong rows = t->counters.rows;
+        memset(&t->counters, 0, sizeof(ADBRowCacheStats));
+        t->counters.rows = rows;
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
+
+/*
+** ADBRowCache::fetch - Looks up a row.  A cached row is copied into buf,
+**                      since it may be dropped as soon as the lock is
+**                      let go, and rowData is pointed at its columns.
+**
+**                      Returns 1 for a cached row, -1 for a cached miss
+**                      and 0 if the server has to be asked.  On a miss,
+**                      generation is set to pass to store() with what the
+**                      server returns.
+*/
+
+int ADBRowCache::fetch(const char *Host, const char *Name, const char *Table, long keyVal, uint numCols, ADBStmtBuf *buf, const char **rowData, ullong *generation)
+{
+    int     retVal = 0;
+    *generation = 0;
+    if (!ADBRowCacheActive) return retVal;
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t) {
+        ADBRowCacheEntry *e = ADBRowCacheLookup(t, keyVal);
+        if (e && e->expires && e->expires <= time(NULL)) {
+            ADBRowCacheRemove(t, e);
+            t->counters.expirations++;
+            e = NULL;
+        }
+        if (e && e->data && e->numCols != numCols) {
+            // The table has changed shape since the row was cached.
+            ADBRowCacheRemove(t, e);
+            e = NULL;
+        }
+
+        if (!e) {
+            t->counters.misses++;
+            *generation = t->generation;
+        } else {
+            ADBRowCacheUnlink(t, e);
+            ADBRowCachePushFront(t, e);
+            if (!e->data) {
+                t->counters.negativeHits++;
+                retVal = -1;
+            } else {
+                t->counters.hits++;
+                buf->clear();
+                buf->append(e->data, e->dataLen);
+                retVal = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+
+    // Split the copy back into its columns.
+    if (retVal > 0) {
+        const char *pos = buf->data();
+        for (uint i = 0; i < numCols; i++) {
+            rowData[i] = pos;
+            pos += strlen(pos) + 1;
+        }
+    }
+    return retVal;
+}
+
+/*
+** ADBRowCache::store - Caches a row just loaded from the server.  NULL
+**                      columns are kept as empty strings, which is how
+**                      ADBTable loads them anyway.  The row is dropped if
+**                      the table has been invalidated since fetch() set
+**                      generation.
+*/
+
+void ADBRowCache::store(const char *Host, const char *Name, const char *Table, long keyVal, uint numCols, const char * const *rowData, ullong generation)
+{
+    if (!ADBRowCacheActive) return;
+
+    // Pack the row before taking the lock.
+    ulong   dataLen = 0;
+    for (uint i = 0; i < numCols; i++) dataLen += (rowData[i] ? strlen(rowData[i]) : 0) + 1;
+    char    *data = (char *) malloc(dataLen);
+    char    *pos  = data;
+    for (uint i = 0; i < numCols; i++) {
+        ulong   colLen = rowData[i] ? strlen(rowData[i]) : 0;
+        if (colLen) memcpy(pos, rowData[i], colLen);
+        pos[colLen] = '\0';
+        pos += colLen + 1;
+    }
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t && t->generation == generation) {
+        ADBRowCacheInsert(t, keyVal, numCols, data, dataLen, t->ttlSecs);
+        data = NULL;
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+    free(data);
+}
+
+/*
+** ADBRowCache::storeMissing - Remembers that the server has no row for a
+**                             key, if the table caches misses.  As with
+**                             store(), nothing is kept if the table has
+**                             been invalidated since the fetch().
+*/
+
+void ADBRowCache::storeMissing(const char *Host, const char *Name, const char *Table, long keyVal, ullong generation)
+{
+    if (!ADBRowCacheActive) return;
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t && t->negTtlSecs && t->generation == generation) ADBRowCacheInsert(t, keyVal, 0, NULL, 0, t->negTtlSecs);
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
+
+/*
+** ADBRowCache::invalidate - Drops the row (or miss) for a key, i.e. after
+**                           it has been changed.
+*/
+
+void ADBRowCache::invalidate(const char *Host, const char *Name, const char *Table, long keyVal)
+{
+    if (!ADBRowCacheActive) return;
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t) {
+        // Even with nothing cached, a get() may be about to store the
+        // row as it was before the change.
+        t->generation = ++ADBRowCacheGenSeq;
+        ADBRowCacheEntry *e = ADBRowCacheLookup(t, keyVal);
+        if (e) {
+            ADBRowCacheRemove(t, e);
+            t->counters.invalidations++;
+        }
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
+
+/*
+** ADBRowCache::invalidateRange - Drops the rows (and misses) for a range
+**                                of keys, i.e. after a batch insert.
+*/
+
+void ADBRowCache::invalidateRange(const char *Host, const char *Name, const char *Table, long firstKey, long lastKey)
+{
+    if (!ADBRowCacheActive) return;
+
+    pthread_mutex_lock(&ADBRowCacheLock);
+    ADBRowCacheTable *t = ADBRowCacheFind(Host, Name, Table);
+    if (t) {
+        t->generation = ++ADBRowCacheGenSeq;
+
+        // Walk whichever is shorter, the range or the cache.
+        if (lastKey >= firstKey && (ullong) lastKey - (ullong) firstKey < t->counters.rows) {
+            for (long keyVal = firstKey; keyVal <= lastKey; keyVal++) {
+                ADBRowCacheEntry *e = ADBRowCacheLookup(t, keyVal);
+                if (e) {
+                    ADBRowCacheRemove(t, e);
+                    t->counters.invalidations++;
+                }
+            }
+        } else {
+            ADBRowCacheEntry *e = t->lruHead;
+            while (e) {
+                ADBRowCacheEntry *next = e->lruNext;
+                if (e->key >= firstKey && e->key <= lastKey) {
+                    ADBRowCacheRemove(t, e);
+                    t->counters.invalidations++;
+                }
+                e = next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ADBRowCacheLock);
+}
@@ -0,0 +1,135 @@
+/**
+ * ADBRowSet.cpp - The rows loaded by ADBTable::getMany().
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ADB.h>
+#include <mysql/mysql.h>
+
+ADBRowSet::ADBRowSet()
+{
+    results     = NULL;
+    numResults  = 0;
+    resultSpace = 0;
+    rows        = NULL;
+    keys        = NULL;
+    numRows     = 0;
+    rowSpace    = 0;
+}
+
+ADBRowSet::~ADBRowSet()
+{
+    clear();
+    free(results);
+    free(rows);
+    free(keys);
+}
+
+/*
+** ADBRowSet::clear - Frees the rows.  The arrays are kept for reuse.
+*/
+
+void ADBRowSet::clear()
+{
+    for (uint i = 0; i < numResults; i++) mysql_free_result(results[i]);
+    numResults = 0;
+    numRows    = 0;
+}
+
+/*
+** ADBRowSet::count - Returns the number of rows.
+*/
+
+ulong ADBRowSet::count()
+{
+    return numRows;
+}
+
+/*
+** ADBRowSet::key - Returns the primary key of a row, or 0 if there is no
+**                  such row.
+*/
+
+long ADBRowSet::key(ulong rowNo)
+{
+    return rowNo < numRows ? keys[rowNo] : 0;
+}
+
+/*
+** ADBRowSet::find - Returns the row number of the row with the given key,
+**                   or -1 if there isn't one.  The rows are in key order
+**                   so this is a binary search.
+*/
+
+long ADBRowSet::find(long keyVal)
+{
+    ulong   lo = 0;
+    ulong   hi = numRows;
+    while (lo < hi) {
+        ulong   mid = lo + (hi - lo) / 2;
+        if (keys[mid] < keyVal) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < numRows && keys[lo] == keyVal) ? (long) lo : -1;
+}
+
+/*
+** ADBRowSet::row - Returns a row as the server sent it, or NULL if there
+**                  is no such row.
+*/
+
+const char * const *ADBRowSet::row(ulong rowNo)
+{
+    return rowNo < numRows ? rows[rowNo] : NULL;
+}
+
+/*
+** ADBRowSet::addResult - Takes over a result and adds its rows, which
+**                        must come after the rows already held in key
+**                        order.
+*/
+
+void ADBRowSet::addResult(MYSQL_RES *res, uint keyColumn)
+{
+    if (numResults >= resultSpace) {
+        resultSpace = resultSpace ? resultSpace * 2 : 8;
+        results     = (MYSQL_RES **) realloc(results, resultSpace * sizeof(MYSQL_RES *));
+    }
+    results[numResults++] = res;
+
+    ulong   newRows = mysql_num_rows(res);
+    if (numRows + newRows > rowSpace) {
+        while (numRows + newRows > rowSpace) rowSpace = rowSpace ? rowSpace * 2 : 1024;
+        rows = (MYSQL_ROW *) realloc(rows, rowSpace * sizeof(MYSQL_ROW));
+        keys = (long *) realloc(keys, rowSpace * sizeof(long));
+    }
+
+    MYSQL_ROW   row;
+    while ((row = mysql_fetch_row(res))) {
+        rows[numRows] = row;
+        keys[numRows] = row[keyColumn] ? atol(row[keyColumn]) : 0;
+        numRows++;
+    }
+}
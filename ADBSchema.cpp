@@ -0,0 +1,482 @@
+/**
+ * ADBSchema.cpp - A process-wide cache of table definitions used by
+ *                 ADBTable::setTableName().
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * The first ADBTable for a given table loads the column definitions from
+ * the server and stores them here.  Every ADBTable after that copies the
+ * definitions out of the cache without talking to the server.
+ *
+ * preload() fills the cache for every table in a database with a single
+ * query against information_schema, and save()/load() write and read a
+ * snapshot of the cache so short lived programs (CGI's) can skip the
+ * schema queries entirely.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <ADB.h>
+#include <mysql/mysql.h>
+
+#define ADB_SCHEMA_BUCKETS  256
+#define ADB_SCHEMA_MAGIC    "# ADBSchema snapshot 3"
+
+// A cached table definition.
+struct ADBSchemaTable
+{
+    char            *host;
+    char            *name;
+    char            *table;
+    uint            numColumns;
+    ADBSchemaColumn *columns;
+    ADBSchemaTable  *next;
+};
+
+static  pthread_rwlock_t    ADBSchemaLock = PTHREAD_RWLOCK_INITIALIZER;
+static  ADBSchemaTable      *ADBSchemaBuckets[ADB_SCHEMA_BUCKETS];
+static  bool                ADBSchemaEnabled = true;
+
+/*
+** ADBSchemaHash - Hashes the table name into a bucket number.
+*/
+
+static uint ADBSchemaHash(const char *table)
+{
+    uint h = 2166136261u;
+    for (const char *p = table; *p; p++) {
+        h ^= (unsigned char) *p;
+        h *= 16777619u;
+    }
+    return h % ADB_SCHEMA_BUCKETS;
+}
+
+/*
+** ADBSchemaFind - Finds a cached table.  The caller must hold the lock.
+*/
+
+static ADBSchemaTable *ADBSchemaFind(const char *Host, const char *Name, const char *Table)
+{
+    for (ADBSchemaTable *t = ADBSchemaBuckets[ADBSchemaHash(Table)]; t; t = t->next) {
+        if (!strcmp(t->table, Table) && !strcmp(t->name, Name) && !strcmp(t->host, Host)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*
+** ADBSchemaStrDup - A strdup() that uses calloc like the rest of ADB.
+*/
+
+static char *ADBSchemaStrDup(const char *src)
+{
+    char *retVal = (char *) calloc(strlen(src)+1, sizeof(char));
+    strcpy(retVal, src);
+    return retVal;
+}
+
+/*
+** ADBSchema::setEnabled - Turns the schema cache on or off.  When it is
+**                         off every ADBTable queries the server.
+*/
+
+void ADBSchema::setEnabled(bool newVal)
+{
+    ADBSchemaEnabled = newVal;
+}
+
+/*
+** ADBSchema::enabled - Returns true if the schema cache is in use.
+*/
+
+bool ADBSchema::enabled()
+{
+    return ADBSchemaEnabled;
+}
+
+/*
+** ADBSchema::parseType - Turns a MySQL column type as returned by SHOW
+**                        COLUMNS or information_schema.COLUMNS.COLUMN_TYPE
+**                        ("int(11) unsigned", "varchar(64)", etc) into a
+**                        field type.  Types we don't know about come back
+**                        as FIELD_TYPE_NULL and are treated as strings.
+*/
+
+enum_field_types ADBSchema::parseType(const char *typeStr)
+{
+    enum_field_types retVal = FIELD_TYPE_NULL;
+    if (!typeStr) return retVal;
+
+    // Dispatch on the first character, then check the longer names
+    // before the shorter names they start with (datetime before date,
+    // timestamp before time).
+    switch (tolower(typeStr[0])) {
+        case 'b':
+            if      (!strncasecmp(typeStr, "bigint",     6))  retVal = FIELD_TYPE_LONGLONG;
+            else if (!strncasecmp(typeStr, "blob",       4))  retVal = FIELD_TYPE_BLOB;
+            break;
+        case 'c':
+            if      (!strncasecmp(typeStr, "char",       4))  retVal = FIELD_TYPE_STRING;
+            break;
+        case 'd':
+            if      (!strncasecmp(typeStr, "datetime",   8))  retVal = FIELD_TYPE_DATETIME;
+            else if (!strncasecmp(typeStr, "date",       4))  retVal = FIELD_TYPE_DATE;
+            break;
+        case 'e':
+            if      (!strncasecmp(typeStr, "enum",       4))  retVal = FIELD_TYPE_ENUM;
+            break;
+        case 'f':
+            if      (!strncasecmp(typeStr, "float",      5))  retVal = FIELD_TYPE_FLOAT;
+            break;
+        case 'i':
+            if      (!strncasecmp(typeStr, "int",        3))  retVal = FIELD_TYPE_SHORT;
+            break;
+        case 'l':
+            if      (!strncasecmp(typeStr, "longblob",   8))  retVal = FIELD_TYPE_LONG_BLOB;
+            else if (!strncasecmp(typeStr, "longtext",   8))  retVal = FIELD_TYPE_LONG_BLOB;
+            break;
+        case 'm':
+            if      (!strncasecmp(typeStr, "mediumblob", 10)) retVal = FIELD_TYPE_MEDIUM_BLOB;
+            else if (!strncasecmp(typeStr, "mediumtext", 10)) retVal = FIELD_TYPE_MEDIUM_BLOB;
+            break;
+        case 's':
+            if      (!strncasecmp(typeStr, "set",        3))  retVal = FIELD_TYPE_SET;
+            break;
+        case 't':
+            if      (!strncasecmp(typeStr, "timestamp",  9))  retVal = FIELD_TYPE_TIMESTAMP;
+            else if (!strncasecmp(typeStr, "time",       4))  retVal = FIELD_TYPE_TIME;
+            else if (!strncasecmp(typeStr, "tinyblob",   8))  retVal = FIELD_TYPE_TINY_BLOB;
+            else if (!strncasecmp(typeStr, "tinytext",   8))  retVal = FIELD_TYPE_TINY_BLOB;
+            else if (!strncasecmp(typeStr, "text",       4))  retVal = FIELD_TYPE_BLOB;
+            break;
+        case 'v':
+            if      (!strncasecmp(typeStr, "varchar",    7))  retVal = FIELD_TYPE_VAR_STRING;
+            break;
+        case 'y':
+            if      (!strncasecmp(typeStr, "year",       4))  retVal = FIELD_TYPE_YEAR;
+            break;
+    }
+    return retVal;
+}
+
+/*
+** ADBSchema::parseServerSet - Works out the ADB_SRVSET_* flags for a column
+**                             from the Default and Extra columns of SHOW
+**                             COLUMNS (or COLUMN_DEFAULT and EXTRA from
+**                             information_schema.COLUMNS).  Plain literal
+**                             defaults don't count, since ADBTable always
+**                             sends a value for every column it inserts.
+*/
+
+int ADBSchema::parseServerSet(const char *defaultStr, const char *extraStr)
+{
+    int retVal = 0;
+    if (extraStr) {
+        if (strcasestr(extraStr, "auto_increment"))     retVal |= ADB_SRVSET_AUTOINC;
+        if (strcasestr(extraStr, "on update"))          retVal |= ADB_SRVSET_ONUPDATE;
+        // MySQL 8 flags expression defaults as DEFAULT_GENERATED, which
+        // isn't a generated column.
+        if (strcasestr(extraStr, "DEFAULT_GENERATED"))  retVal |= ADB_SRVSET_DEFAULT;
+        else if (strcasestr(extraStr, "GENERATED"))     retVal |= ADB_SRVSET_GENERATED;
+    }
+    if (defaultStr) {
+        if (!strncasecmp(defaultStr, "current_timestamp", 17) ||
+            !strncasecmp(defaultStr, "now(", 4) ||
+            defaultStr[0] == '(') {
+            retVal |= ADB_SRVSET_DEFAULT;
+        }
+    }
+    return retVal;
+}
+
+/*
+** ADBSchema::lookup - Copies the cached definition of a table into cols.
+**
+**                     Returns the number of columns, or 0 if the table
+**                     is not in the cache.
+*/
+
+uint ADBSchema::lookup(const char *Host, const char *Name, const char *Table, ADBSchemaColumn *cols, uint maxCols)
+{
+    uint retVal = 0;
+    if (!ADBSchemaEnabled || !Host || !Name || !Table) return retVal;
+
+    pthread_rwlock_rdlock(&ADBSchemaLock);
+    ADBSchemaTable *t = ADBSchemaFind(Host, Name, Table);
+    if (t) {
+        retVal = t->numColumns;
+        if (retVal > maxCols) retVal = maxCols;
+        memcpy(cols, t->columns, retVal * sizeof(ADBSchemaColumn));
+    }
+    pthread_rwlock_unlock(&ADBSchemaLock);
+    return retVal;
+}
+
+/*
+** ADBSchema::store - Adds or replaces a table definition in the cache.
+*/
+
+void ADBSchema::store(const char *Host, const char *Name, const char *Table, const ADBSchemaColumn *cols, uint numCols)
+{
+    if (!ADBSchemaEnabled || !Host || !Name || !Table || !numCols) return;
+
+    ADBSchemaColumn *newCols = (ADBSchemaColumn *) calloc(numCols, sizeof(ADBSchemaColumn));
+    memcpy(newCols, cols, numCols * sizeof(ADBSchemaColumn));
+
+    pthread_rwlock_wrlock(&ADBSchemaLock);
+    ADBSchemaTable *t = ADBSchemaFind(Host, Name, Table);
+    if (t) {
+        free(t->columns);
+    } else {
+        uint bucket = ADBSchemaHash(Table);
+        t = (ADBSchemaTable *) calloc(1, sizeof(ADBSchemaTable));
+        t->host  = ADBSchemaStrDup(Host);
+        t->name  = ADBSchemaStrDup(Name);
+        t->table = ADBSchemaStrDup(Table);
+        t->next  = ADBSchemaBuckets[bucket];
+        ADBSchemaBuckets[bucket] = t;
+    }
+    t->columns    = newCols;
+    t->numColumns = numCols;
+    pthread_rwlock_unlock(&ADBSchemaLock);
+}
+
+/*
+** ADBSchema::invalidate - Drops a single table from the cache, i.e. after
+**                         an ALTER TABLE.
+*/
+
+void ADBSchema::invalidate(const char *Host, const char *Name, const char *Table)
+{
+    if (!Host || !Name || !Table) return;
+
+    pthread_rwlock_wrlock(&ADBSchemaLock);
+    for (ADBSchemaTable **prev = &ADBSchemaBuckets[ADBSchemaHash(Table)]; *prev; prev = &(*prev)->next) {
+        ADBSchemaTable *t = *prev;
+        if (!strcmp(t->table, Table) && !strcmp(t->name, Name) && !strcmp(t->host, Host)) {
+            *prev = t->next;
+            free(t->host);
+            free(t->name);
+            free(t->table);
+            free(t->columns);
+            free(t);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&ADBSchemaLock);
+}
+
+/*
+** ADBSchema::clear - Empties the cache.
+*/
+
+void ADBSchema::clear()
+{
+    pthread_rwlock_wrlock(&ADBSchemaLock);
+    for (uint i = 0; i < ADB_SCHEMA_BUCKETS; i++) {
+        while (ADBSchemaBuckets[i]) {
+            ADBSchemaTable *t = ADBSchemaBuckets[i];
+            ADBSchemaBuckets[i] = t->next;
+            free(t->host);
+            free(t->name);
+            free(t->table);
+            free(t->columns);
+            free(t);
+        }
+    }
+    pthread_rwlock_unlock(&ADBSchemaLock);
+}
+
+/*
+** ADBSchema::preload - Loads the definition of every table in a database
+**                      in a single query.  Any of the connect arguments
+**                      that are NULL use the ADB defaults.
+**
+**                      Returns the number of tables loaded.
+*/
+
+int ADBSchema::preload(const char *Name, const char *User, const char *Pass, const char *Host)
+{
+    if (!Name) Name = ADB::defaultDBase();
+    if (!Host) Host = ADB::defaultHost();
+
+    int retVal = 0;
+    ADB DB(Name, User, Pass, Host);
+    if (!DB.Connected()) return retVal;
+
+    if (!DB.query("SELECT TABLE_NAME, COLUMN_NAME, COLUMN_TYPE, COLUMN_KEY, COLUMN_DEFAULT, EXTRA FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = '%s' ORDER BY TABLE_NAME, ORDINAL_POSITION", DB.escapeString(Name))) {
+        return retVal;
+    }
+
+    ADBSchemaColumn cols[ADB_MAXCOLS];
+    char            curTable[256] = "";
+    uint            numCols = 0;
+    while (DB.getrow()) {
+        if (strcmp(curTable, DB.curRow[0])) {
+            if (numCols) {
+                store(Host, Name, curTable, cols, numCols);
+                retVal++;
+            }
+            strncpy(curTable, DB.curRow[0], sizeof(curTable) - 1);
+            numCols = 0;
+        }
+        if (numCols >= ADB_MAXCOLS) continue;
+
+        memset(&cols[numCols], 0, sizeof(ADBSchemaColumn));
+        strncpy(cols[numCols].name, DB.curRow[1], ADB_MAXCOLWIDTH - 1);
+        cols[numCols].type       = parseType(DB.curRow[2]);
+        cols[numCols].primaryKey = !strcasecmp(DB.curRow[3], "PRI");
+        cols[numCols].serverSet  = parseServerSet(DB.curRow[4], DB.curRow[5]);
+        numCols++;
+    }
+    if (numCols) {
+        store(Host, Name, curTable, cols, numCols);
+        retVal++;
+    }
+
+    ADBDebugMsg(1, "ADBSchema::preload() - Loaded %d tables from %s", retVal, Name);
+    return retVal;
+}
+
+/*
+** ADBSchema::save - Writes the contents of the cache to a snapshot file
+**                   that can be read back with load().
+**
+**                   Returns 1 on success, 0 on failure.
+*/
+
+int ADBSchema::save(const char *fileName)
+{
+    // Write to a temp file and rename it over the target so a reader
+    // never sees half a snapshot.
+    char    tmpName[1024];
+    snprintf(tmpName, sizeof(tmpName), "%s.%d", fileName, (int) getpid());
+    FILE    *fp = fopen(tmpName, "w");
+    if (!fp) {
+        ADBLogMsg(LOG_ERR, "ADBSchema::save() - Unable to open '%s' for writing", tmpName);
+        return 0;
+    }
+
+    fprintf(fp, "%s\n", ADB_SCHEMA_MAGIC);
+    pthread_rwlock_rdlock(&ADBSchemaLock);
+    for (uint i = 0; i < ADB_SCHEMA_BUCKETS; i++) {
+        for (ADBSchemaTable *t = ADBSchemaBuckets[i]; t; t = t->next) {
+            fprintf(fp, "T\t%s\t%s\t%s\t%u\n", t->host, t->name, t->table, t->numColumns);
+            for (uint c = 0; c < t->numColumns; c++) {
+                fprintf(fp, "C\t%s\t%d\t%d\t%d\n", t->columns[c].name, (int) t->columns[c].type, t->columns[c].primaryKey, t->columns[c].serverSet);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&ADBSchemaLock);
+
+    if (fclose(fp) || rename(tmpName, fileName)) {
+        ADBLogMsg(LOG_ERR, "ADBSchema::save() - Unable to write '%s'", fileName);
+        unlink(tmpName);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+** ADBSchema::load - Reads a snapshot written by save() into the cache.
+**
+**                   Returns the number of tables loaded, 0 if the file
+**                   could not be read.
+*/
+
+int ADBSchema::load(const char *fileName)
+{
+    int     retVal = 0;
+    FILE    *fp = fopen(fileName, "r");
+    if (!fp) return retVal;
+
+    char    line[1024];
+    if (!fgets(line, sizeof(line), fp) || strncmp(line, ADB_SCHEMA_MAGIC, strlen(ADB_SCHEMA_MAGIC))) {
+        ADBLogMsg(LOG_WARNING, "ADBSchema::load() - '%s' is not a schema snapshot", fileName);
+        fclose(fp);
+        return retVal;
+    }
+
+    ADBSchemaColumn cols[ADB_MAXCOLS];
+    char            host[256] = "";
+    char            name[256] = "";
+    char            table[256] = "";
+    uint            numCols = 0;
+    uint            expected = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char    *save = NULL;
+        char    *tag  = strtok_r(line, "\t", &save);
+        if (!tag) continue;
+
+        if (!strcmp(tag, "T")) {
+            if (numCols && numCols == expected) {
+                store(host, name, table, cols, numCols);
+                retVal++;
+            }
+            const char  *h = strtok_r(NULL, "\t", &save);
+            const char  *n = strtok_r(NULL, "\t", &save);
+            const char  *t = strtok_r(NULL, "\t", &save);
+            const char  *c = strtok_r(NULL, "\t", &save);
+            numCols  = 0;
+            expected = 0;
+            if (!h || !n || !t || !c) continue;
+            strncpy(host,  h, sizeof(host) - 1);
+            strncpy(name,  n, sizeof(name) - 1);
+            strncpy(table, t, sizeof(table) - 1);
+            expected = atoi(c);
+        } else if (!strcmp(tag, "C") && numCols < expected && numCols < ADB_MAXCOLS) {
+            const char  *c = strtok_r(NULL, "\t", &save);
+            const char  *t = strtok_r(NULL, "\t", &save);
+            const char  *p = strtok_r(NULL, "\t", &save);
+            const char  *s = strtok_r(NULL, "\t", &save);
+            if (!c || !t || !p || !s) continue;
+            memset(&cols[numCols], 0, sizeof(ADBSchemaColumn));
+            strncpy(cols[numCols].name, c, ADB_MAXCOLWIDTH - 1);
+            cols[numCols].type       = (enum_field_types) atoi(t);
+            cols[numCols].primaryKey = atoi(p);
+            cols[numCols].serverSet  = atoi(s);
+            numCols++;
+        }
+    }
+    if (numCols && numCols == expected) {
+        store(host, name, table, cols, numCols);
+        retVal++;
+    }
+    fclose(fp);
+
+    ADBDebugMsg(1, "ADBSchema::load() - Loaded %d tables from '%s'", retVal, fileName);
+    return retVal;
+}
@@ -0,0 +1,243 @@
+/**
+ * ADBStmt.cpp - A per-connection cache of prepared statements used by
+ *               ADBTable for its get/ins/upd/del members.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ ****************************************************************************
+ *
+ * Prepared statements belong to the connection they were prepared on, not
+ * to the ADBTable that asked for them.  Keeping the cache with the
+ * connection means a pooled connection keeps its statements when one
+ * ADBTable is destroyed and the next one borrows it.
+ *
+ * Statements are keyed by table name, statement kind and the set of
+ * columns the statement covers, so an update of columns 2 and 5 and an
+ * update of column 3 are two different statements.
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <ADB.h>
+#include <mysql/mysql.h>
+
+// The most statements we'll hold open on a single connection.  The server
+// has a global limit (max_prepared_stmt_count), so don't be greedy.
+#define ADB_STMT_CACHE_SIZE 32
+
+struct ADBStmtEntry
+{
+    char            table[256];
+    int             kind;
+    ullong          colMask[ADB_COLMASK_WORDS];
+    MYSQL_STMT      *stmt;
+    ulong           lastUsed;
+};
+
+// The registry of caches, one per connection.
+static  pthread_mutex_t ADBStmtLock   = PTHREAD_MUTEX_INITIALIZER;
+static  ADBStmtCache    *ADBStmtCaches = NULL;
+static  bool            ADBStmtEnabled = true;
+
+/*
+** ADBStmtCache::ADBStmtCache - Creates an empty cache for a connection.
+*/
+
+ADBStmtCache::ADBStmtCache(MYSQL *newConn)
+{
+    conn       = newConn;
+    entries    = (ADBStmtEntry *) calloc(ADB_STMT_CACHE_SIZE, sizeof(ADBStmtEntry));
+    numEntries = 0;
+    useCount   = 0;
+    next       = NULL;
+}
+
+/*
+** ADBStmtCache::~ADBStmtCache - Closes all of the statements.
+*/
+
+ADBStmtCache::~ADBStmtCache()
+{
+    clear();
+    free(entries);
+}
+
+/*
+** ADBStmtCache::setEnabled - Turns the use of prepared statements by
+**                            ADBTable on or off.
+*/
+
+void ADBStmtCache::setEnabled(bool newVal)
+{
+    ADBStmtEnabled = newVal;
+}
+
+/*
+** ADBStmtCache::enabled - Returns true if ADBTable should use prepared
+**                         statements.
+*/
+
+bool ADBStmtCache::enabled()
+{
+    return ADBStmtEnabled;
+}
+
+/*
+** ADBStmtCache::forConnection - Returns the cache for a connection,
+**                               creating it if need be.
+*/
+
+ADBStmtCache *ADBStmtCache::forConnection(MYSQL *conn)
+{
+    ADBStmtCache *retVal = NULL;
+    if (!conn) return retVal;
+
+    pthread_mutex_lock(&ADBStmtLock);
+    for (retVal = ADBStmtCaches; retVal; retVal = retVal->next) {
+        if (retVal->conn == conn) break;
+    }
+    if (!retVal) {
+        retVal = new ADBStmtCache(conn);
+        retVal->next  = ADBStmtCaches;
+        ADBStmtCaches = retVal;
+    }
+    pthread_mutex_unlock(&ADBStmtLock);
+    return retVal;
+}
+
+/*
+** ADBStmtCache::dropConnection - Closes and forgets every statement that
+**                                was prepared on a connection.  This must
+**                                be called before the connection is
+**                                closed.
+*/
+
+void ADBStmtCache::dropConnection(MYSQL *conn)
+{
+    ADBStmtCache *found = NULL;
+
+    pthread_mutex_lock(&ADBStmtLock);
+    for (ADBStmtCache **prev = &ADBStmtCaches; *prev; prev = &(*prev)->next) {
+        if ((*prev)->conn == conn) {
+            found = *prev;
+            *prev = found->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ADBStmtLock);
+
+    if (found) delete found;
+}
+
+/*
+** ADBStmtCache::find - Looks up a statement.  Returns NULL if it has not
+**                      been prepared on this connection yet.
+*/
+
+MYSQL_STMT *ADBStmtCache::find(const char *table, int kind, const ullong *colMask)
+{
+    for (uint i = 0; i < numEntries; i++) {
+        ADBStmtEntry *e = &entries[i];
+        if (e->kind == kind && !memcmp(e->colMask, colMask, sizeof(e->colMask)) && !strcmp(e->table, table)) {
+            e->lastUsed = ++useCount;
+            return e->stmt;
+        }
+    }
+    return NULL;
+}
+
+/*
+** ADBStmtCache::prepare - Prepares a statement and adds it to the cache,
+**                         closing the least recently used statement if
+**                         the cache is full.
+**
+**                         Returns NULL if the server would not prepare it.
+*/
+
+MYSQL_STMT *ADBStmtCache::prepare(const char *table, int kind, const ullong *colMask, const char *sql)
+{
+    MYSQL_STMT  *stmt = mysql_stmt_init(conn);
+    if (!stmt) return NULL;
+
+    ADBDebugMsg(2, "ADBStmtCache: Preparing '%s'", sql);
+    if (mysql_stmt_prepare(stmt, sql, strlen(sql))) {
+        ADBLogMsg(LOG_WARNING, "ADBStmtCache: Unable to prepare '%s': %s", sql, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+
+    ADBStmtEntry *e = NULL;
+    if (numEntries < ADB_STMT_CACHE_SIZE) {
+        e = &entries[numEntries++];
+    } else {
+        e = &entries[0];
+        for (uint i = 1; i < numEntries; i++) {
+            if (entries[i].lastUsed < e->lastUsed) e = &entries[i];
+        }
+        mysql_stmt_close(e->stmt);
+    }
+
+    strncpy(e->table, table, sizeof(e->table) - 1);
+    e->table[sizeof(e->table) - 1] = '\0';
+    e->kind     = kind;
+    memcpy(e->colMask, colMask, sizeof(e->colMask));
+    e->stmt     = stmt;
+    e->lastUsed = ++useCount;
+    return stmt;
+}
+
+/*
+** ADBStmtCache::remove - Closes a single statement, i.e. one that failed
+**                        to execute and may no longer be valid.
+*/
+
+void ADBStmtCache::remove(MYSQL_STMT *stmt)
+{
+    for (uint i = 0; i < numEntries; i++) {
+        if (entries[i].stmt == stmt) {
+            mysql_stmt_close(stmt);
+            entries[i] = entries[--numEntries];
+            memset(&entries[numEntries], 0, sizeof(ADBStmtEntry));
+            return;
+        }
+    }
+}
+
+/*
+** ADBStmtCache::clear - Closes all of the statements on this connection.
+*/
+
+void ADBStmtCache::clear()
+{
+    for (uint i = 0; i < numEntries; i++) {
+        mysql_stmt_close(entries[i].stmt);
+    }
+    memset(entries, 0, ADB_STMT_CACHE_SIZE * sizeof(ADBStmtEntry));
+    numEntries = 0;
+}
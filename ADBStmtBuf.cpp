@@ -0,0 +1,189 @@
+/**
+ * ADBStmtBuf.cpp - A growable buffer for building SQL statements.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ADB.h>
+#include <mysql/mysql.h>
+
+// The size of a buffer the first time something is put in it.
+#define ADB_STMTBUF_MIN 4096
+
+/*
+** ADBStmtBuf::ADBStmtBuf - Creates an empty buffer.  Nothing is allocated
+**                          until something is appended.
+*/
+
+ADBStmtBuf::ADBStmtBuf()
+{
+    buf  = NULL;
+    len  = 0;
+    size = 0;
+}
+
+/*
+** ADBStmtBuf::~ADBStmtBuf - Frees the buffer.
+*/
+
+ADBStmtBuf::~ADBStmtBuf()
+{
+    free(buf);
+}
+
+/*
+** ADBStmtBuf::clear - Empties the buffer, keeping its memory.
+*/
+
+void ADBStmtBuf::clear()
+{
+    truncate(0);
+}
+
+/*
+** ADBStmtBuf::truncate - Cuts the contents back to newLen bytes.  The
+**                        bytes after it are left in place.
+*/
+
+void ADBStmtBuf::truncate(ulong newLen)
+{
+    if (newLen > len) return;
+    len = newLen;
+    if (buf) buf[len] = '\0';
+}
+
+/*
+** ADBStmtBuf::reserve - Makes sure there is room for count more bytes and
+**                       a terminating NUL, doubling the buffer as needed.
+**                       Returns where the next bytes go.
+*/
+
+char *ADBStmtBuf::reserve(ulong count)
+{
+    if (len + count + 1 > size) {
+        ulong newSize = size ? size : ADB_STMTBUF_MIN;
+        while (len + count + 1 > newSize) newSize *= 2;
+        buf  = (char *) realloc(buf, newSize);
+        size = newSize;
+        buf[len] = '\0';
+    }
+    return buf + len;
+}
+
+/*
+** ADBStmtBuf::advance - Adds count bytes written after reserve() to the
+**                       contents.
+*/
+
+void ADBStmtBuf::advance(ulong count)
+{
+    len += count;
+    buf[len] = '\0';
+}
+
+/*
+** ADBStmtBuf::append - Appends a single character.
+*/
+
+void ADBStmtBuf::append(char ch)
+{
+    *reserve(1) = ch;
+    advance(1);
+}
+
+/*
+** ADBStmtBuf::append - Appends a string.
+*/
+
+void ADBStmtBuf::append(const char *str)
+{
+    if (str) append(str, strlen(str));
+}
+
+/*
+** ADBStmtBuf::append - Appends strLen bytes.
+*/
+
+void ADBStmtBuf::append(const char *str, ulong strLen)
+{
+    memcpy(reserve(strLen), str, strLen);
+    advance(strLen);
+}
+
+/*
+** ADBStmtBuf::appendLLong - Appends a number as decimal text.
+*/
+
+void ADBStmtBuf::appendLLong(llong val)
+{
+    advance(ADBFormatLLong(reserve(24), val));
+}
+
+/*
+** ADBStmtBuf::appendDouble - Appends a double formatted with "%f", which
+**                            is how the columns have always sent them.
+*/
+
+void ADBStmtBuf::appendDouble(double val)
+{
+    int     valLen = snprintf(reserve(32), 33, "%f", val);
+    if (valLen > 32) snprintf(reserve(valLen), valLen + 1, "%f", val);
+    advance(valLen);
+}
+
+/*
+** ADBStmtBuf::appendQuoted - Appends a string escaped for MySQL and wrapped
+**                            in single quotes.  The escaping is done
+**                            straight into the buffer.
+*/
+
+void ADBStmtBuf::appendQuoted(const char *str, ulong strLen)
+{
+    // Escaping can at most double the string.
+    char    *pos = reserve(strLen * 2 + 2);
+    *pos++ = '\'';
+    pos += ADBEscapeString(pos, str, strLen);
+    *pos++ = '\'';
+    advance(pos - (buf + len));
+}
+
+/*
+** ADBStmtBuf::data - Returns the contents.
+*/
+
+const char *ADBStmtBuf::data()
+{
+    return buf ? buf : "";
+}
+
+/*
+** ADBStmtBuf::length - Returns the length of the contents.
+*/
+
+ulong ADBStmtBuf::length()
+{
+    return len;
+}
@@ -27,11 +27,46 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <syslog.h>
+#include <limits.h>
 #include <string.h>
 #include <ADB.h>
 #include "bdes.h"
 
 
+// Scratch space for binding our columns to prepared statements.  The
+// result buffers are kept between calls so a steady stream of get()'s
+// doesn't allocate anything.
+struct ADBTableStmt
+{
+    MYSQL_BIND      params[ADB_MAXCOLS + 1];
+    llong           intVals[ADB_MAXCOLS + 1];
+    double          dblVals[ADB_MAXCOLS + 1];
+    unsigned long   lengths[ADB_MAXCOLS + 1];
+
+    MYSQL_BIND      results[ADB_MAXCOLS];
+    char            *resBufs[ADB_MAXCOLS];
+    unsigned long   resSizes[ADB_MAXCOLS];
+    unsigned long   resLens[ADB_MAXCOLS];
+    my_bool         resNulls[ADB_MAXCOLS];
+    my_bool         resErrors[ADB_MAXCOLS];
+};
+
+// A multi-row insert being built by batchAdd().
+struct ADBTableBatch
+{
+    int             open;
+    int             upsert;
+    ADBStmtBuf      sql;
+    ADBStmtBuf      suffix;
+    ADBStmtBuf      rowBuf;
+    ulong           prefixLen;
+    ulong           maxPacket;
+    long            rows;
+    long            inserted;
+    long            updated;
+    long            firstKey;
+    long            lastKey;
+};
 
 
 ADBTable::ADBTable(
@@ -46,6 +81,13 @@ ADBTable::ADBTable(
 
     numColumns = 0;
     primaryKeyColumn = ADB_MAXCOLS + 1;
+    projActive = 0;
+    lazyKey    = 0;
+    cacheGen   = 0;
+    memset(projMask, 0, sizeof(projMask));
+    memset(lazyMask, 0, sizeof(lazyMask));
+    stmtData = (ADBTableStmt *) calloc(1, sizeof(ADBTableStmt));
+    batchData = new ADBTableBatch();
 
     if (Table && strlen(Table)) {
         setTableName(Table);
@@ -55,12 +97,27 @@ ADBTable::ADBTable(
 
 ADBTable::~ADBTable()
 {
+    // Send any rows still queued, so they are in the transaction, if
+    // there is one, before it is finished.
+    if (batchData->open && batchData->rows) {
+        ADBDebugMsg(2, "ADBTable::~ADBTable() - Flushing %ld batched rows for '%s'", batchData->rows, TableName);
+        batchFlush();
+    }
+
+    // Finish any transaction while transactionDone() is still ours.
+    closeTransaction();
+
     if (numColumns) {
         for (uint i = 0; i < numColumns; i++) {
             delete columnDefs[i];
         }
         numColumns = 0;
     }
+    for (uint i = 0; i < ADB_MAXCOLS; i++) {
+        if (stmtData->resBufs[i]) free(stmtData->resBufs[i]);
+    }
+    free(stmtData);
+    delete batchData;
 }
 
 /*
@@ -69,53 +126,65 @@ ADBTable::~ADBTable()
 **
 ** This one is a bit annoying compared to the DBRow class.  To get the names
 ** of the columns we actually have to parse the query and do things manually.
+** The results are kept in the ADBSchema cache so we only have to do it once
+** per table per process.
 */
 
 void ADBTable::setTableName(const char * tabName)
 {
-    query("SHOW COLUMNS FROM %s", tabName);
+    ADBSchemaColumn schema[ADB_MAXCOLS];
+    uint            schemaCols;
+
+    // Throw away any definitions we already have.
+    for (uint i = 0; i < numColumns; i++) delete columnDefs[i];
     numColumns = 0;
-    enum_field_types    tmpType;
-    while (getrow()) {
-        ADBDebugMsg(7, "ADBTable::setTableName column 0 = '%s'", (const char *) curRow[0]);
+    primaryKeyColumn = ADB_MAXCOLS + 1;
+    colIndex.clear();
+    colArena.reset();
+    projActive = 0;
+    memset(lazyMask, 0, sizeof(lazyMask));
+
+    schemaCols = ADBSchema::lookup(DBHost, DBName, tabName, schema, ADB_MAXCOLS);
+    if (schemaCols) {
+        ADBDebugMsg(7, "ADBTable::setTableName - using cached definition for '%s'", tabName);
+    } else {
+        query("SHOW COLUMNS FROM %s", tabName);
+        while (getrow() && schemaCols < ADB_MAXCOLS) {
+            ADBDebugMsg(7, "ADBTable::setTableName column 0 = '%s'", (const char *) curRow[0]);
+            memset(&schema[schemaCols], 0, sizeof(ADBSchemaColumn));
+            strncpy(schema[schemaCols].name, curRow["Field"], ADB_MAXCOLWIDTH - 1);
+
+            // Now, we have some fun.  We need to parse column 1, which is our
+            // Type, this is ugly and I hate it, but it seems there is no other
+            // way to get the column information from the MySQL sever without
+            // actually loading a row, which won't work if the table is empty.
+            // So, we parse.
+            ADBDebugMsg(7, "ADBTable::setTableName - determining type ('%s')", curRow[1]);
+            schema[schemaCols].type = ADBSchema::parseType(curRow[1]);
+
+            // Now, check for the primary key.  It is column 3.
+            schema[schemaCols].primaryKey = !strcasecmp(curRow[3], "PRI");
+
+            // And whether the server may set the column itself.
+            schema[schemaCols].serverSet = ADBSchema::parseServerSet(curRow["Default"], curRow["Extra"]);
+            schemaCols++;
+        }
+        ADBSchema::store(DBHost, DBName, tabName, schema, schemaCols);
+    }
+
+    for (uint i = 0; i < schemaCols; i++) {
         columnDefs[numColumns] = new ADBColumn();
+        columnDefs[numColumns]->setArena(&colArena);
         columnDefs[numColumns]->setDebugLevel(debugLevel);
         columnDefs[numColumns]->setColumnNumber(numColumns);
-        columnDefs[numColumns]->setColumnName(curRow["Field"]);
-        
-        // Now, we have some fun.  We need to parse column 1, which is our
-        // Type, this is ugly and I hate it, but it seems there is no other
-        // way to get the column information from the MySQL sever without
-        // actually loading a row, which won't work if the table is empty.
-        // So, we parse.
-        ADBDebugMsg(7, "ADBTable::setTableName - determining type ('%s')", curRow[1]);
-        tmpType = FIELD_TYPE_NULL;
-        if (!strncasecmp(curRow[1], "int",        strlen("int")))        tmpType = FIELD_TYPE_SHORT;
-        if (!strncasecmp(curRow[1], "bigint",     strlen("bigint")))     tmpType = FIELD_TYPE_LONGLONG;
-        if (!strncasecmp(curRow[1], "char",       strlen("char")))       tmpType = FIELD_TYPE_STRING;
-        if (!strncasecmp(curRow[1], "varchar",    strlen("varchar")))    tmpType = FIELD_TYPE_VAR_STRING;
-        if (!strncasecmp(curRow[1], "float",      strlen("float")))      tmpType = FIELD_TYPE_FLOAT;
-        if (!strncasecmp(curRow[1], "blob",       strlen("blob")))       tmpType = FIELD_TYPE_BLOB;
-        if (!strncasecmp(curRow[1], "tinyblob",   strlen("tinyblob")))   tmpType = FIELD_TYPE_TINY_BLOB;
-        if (!strncasecmp(curRow[1], "mediumblob", strlen("mediumblob"))) tmpType = FIELD_TYPE_MEDIUM_BLOB;
-        if (!strncasecmp(curRow[1], "longblob",   strlen("longblob")))   tmpType = FIELD_TYPE_LONG_BLOB;
-        if (!strncasecmp(curRow[1], "year",       strlen("year")))       tmpType = FIELD_TYPE_YEAR;
-        if (!strncasecmp(curRow[1], "date",       strlen("date")))       tmpType = FIELD_TYPE_DATE;
-        if (!strncasecmp(curRow[1], "time",       strlen("time")))       tmpType = FIELD_TYPE_TIME;
-        if (!strncasecmp(curRow[1], "datetime",   strlen("datetime")))   tmpType = FIELD_TYPE_DATETIME;
-        if (!strncasecmp(curRow[1], "timestamp",  strlen("timestamp")))  tmpType = FIELD_TYPE_TIMESTAMP;
-        if (!strncasecmp(curRow[1], "set",        strlen("set")))        tmpType = FIELD_TYPE_SET;
-        if (!strncasecmp(curRow[1], "enum",       strlen("enum")))       tmpType = FIELD_TYPE_ENUM;
-
-        columnDefs[numColumns]->setType(tmpType);
-        
-        // Now, check for the primary key.  It is column 3.
-        if (!strcasecmp(curRow[3], "PRI")) {
+        columnDefs[numColumns]->setColumnName(schema[i].name);
+        columnDefs[numColumns]->setType(schema[i].type);
+        if (schema[i].primaryKey) {
             columnDefs[numColumns]->setPrimaryKey(1);
             primaryKeyColumn = numColumns;
         }
-
-
+        columnDefs[numColumns]->setServerSet(schema[i].serverSet);
+        colIndex.add(columnDefs[numColumns]->ColumnName(), numColumns);
         numColumns++;
     }
     
@@ -139,6 +208,27 @@ void ADBTable::clearData(void)
             columnDefs[i]->clearData();
         }
     }
+    // Nothing is using the arena now.
+    colArena.reset();
+    memset(lazyMask, 0, sizeof(lazyMask));
+}
+
+/*
+** ADBTable::loadColumns - Copies a row into the columns.  The columns are
+**                         all cleared first, so the arena they keep their
+**                         data in can start over.
+*/
+
+void ADBTable::loadColumns(const char * const *rowData)
+{
+    for (uint i = 0; i < numColumns; i++) {
+        columnDefs[i]->clearData();
+    }
+    colArena.reset();
+    for (uint i = 0; i < numColumns; i++) {
+        columnDefs[i]->set(rowData[i], 1, columnDefs[i]->Encrypted());
+    }
+    memset(lazyMask, 0, sizeof(lazyMask));
 }
 
 /*
@@ -291,6 +381,9 @@ int ADBTable::appendStr(uint colNo, const char *val)
 {
     int retVal = 0;
     if (colNo < numColumns) {
+        // Appending reads the old value, so a column the projection left
+        // out has to be fetched first.
+        ensureLoaded(colNo);
         columnDefs[colNo]->append(val);
         retVal = 1;
     }
@@ -389,6 +482,7 @@ int ADBTable::getInt(uint colNo, int useBackup)
 {
     int retVal = 0;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toInt(useBackup);
     }
     return retVal;
@@ -412,6 +506,7 @@ long ADBTable::getLong(uint colNo, int useBackup)
 {
     long retVal = 0;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toLong(useBackup);
     }
     return retVal;
@@ -434,6 +529,7 @@ llong ADBTable::getLLong(uint colNo, int useBackup)
 {
     llong retVal = 0;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toLLong(useBackup);
     }
     return retVal;
@@ -457,6 +553,7 @@ float ADBTable::getFloat(uint colNo, int useBackup)
 {
     float retVal = 0;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toFloat(useBackup);
     }
     return retVal;
@@ -479,6 +576,7 @@ const char *ADBTable::getStr(uint colNo, int useBackup)
 {
     const char *retVal = NULL;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         return columnDefs[colNo]->Data(useBackup);
     }
     return retVal;
@@ -501,6 +599,7 @@ time_t ADBTable::getTime_t(uint colNo, int useBackup)
 {
     time_t retVal = 0;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toTime_t(useBackup);
     }
     return retVal;
@@ -525,6 +624,7 @@ const QDate ADBTable::getDate(uint colNo, int useBackup)
 {
     QDate retVal;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toQDate(useBackup);
     }
     return (const QDate) retVal;
@@ -547,6 +647,7 @@ const QTime ADBTable::getTime(uint colNo, int useBackup)
 {
     QTime retVal;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toQTime(useBackup);
     }
     return (const QTime) retVal;
@@ -569,6 +670,7 @@ const QDateTime ADBTable::getDateTime(uint colNo, int useBackup)
 {
     QDateTime retVal;
     if (colNo < numColumns) {
+        ensureLoaded(colNo);
         retVal = columnDefs[colNo]->toQDateTime(useBackup);
     }
     return (const QDateTime) retVal;
@@ -595,18 +697,36 @@ long  ADBTable::get(long keyVal)
     long    retVal = 0;
     
     if (primaryKeyColumn < numColumns) {
-        query("SELECT * FROM %s where %s = %ld", 
+        // Check the row cache, if this table has one.  Inside a
+        // transaction the cache could be missing our own changes.
+        const char *rowData[ADB_MAXCOLS];
+        int cached = inTransaction() ? 0 : ADBRowCache::fetch(DBHost, DBName, TableName, keyVal, numColumns, &cacheBuf, rowData, &cacheGen);
+        if (cached) {
+            rowCount = cached > 0 ? 1 : 0;
+            if (cached > 0) loadColumns(rowData);
+            return cached > 0 ? keyVal : 0;
+        }
+
+        // Leave out the columns the projection says to.
+        if (projActive) return getProjected(keyVal);
+
+        // Try the prepared statement next.
+        retVal = stmtGet(keyVal);
+        if (retVal >= 0) return retVal;
+        retVal = 0;
+
+        int queryOk = query("SELECT * FROM %s where %s = %ld", 
           TableName,  
           columnDefs[primaryKeyColumn]->ColumnName(),
           keyVal
         );
+        if (queryOk && !rowCount && !inTransaction()) ADBRowCache::storeMissing(DBHost, DBName, TableName, keyVal, cacheGen);
         if (rowCount) {
             getrow();
             // Now, copy the row contents into our internal values.
-            for (uint i = 0; i < numColumns; i++) {
-                columnDefs[i]->clearData();
-                columnDefs[i]->set(curRow[i], 1, columnDefs[i]->Encrypted());
-            }
+            for (uint i = 0; i < numColumns; i++) rowData[i] = curRow[i];
+            loadColumns(rowData);
+            if (!inTransaction()) ADBRowCache::store(DBHost, DBName, TableName, keyVal, numColumns, rowData, cacheGen);
             retVal = keyVal;
         }
 
@@ -619,88 +739,242 @@ long  ADBTable::get(long keyVal)
 
 
 /*
-** get   - Gets a data row based on an int key.
+** get   - Gets a data row based on an int key.  This shares the cached
+**         statement with get(long).
 */
 
 int ADBTable::get(int keyVal)
 {
-    int retVal = 0;
-    
-    if (primaryKeyColumn < numColumns) {
-        query("SELECT * FROM %s where %s = %d", 
-          TableName,  
-          columnDefs[primaryKeyColumn]->ColumnName(),
-          keyVal
-        );
-        if (rowCount) {
-            getrow();
-            // Now, copy the row contents into our internal values.
-            for (uint i = 0; i < numColumns; i++) {
-                columnDefs[i]->clearData();
-                columnDefs[i]->set(curRow[i], 1);
+    return (int) get((long) keyVal);
+}
+
+/*
+** setProjection - Sets the columns get() loads.  colNames is a comma
+**                 separated list, and the primary key is always loaded.
+**                 With excludeBlobs set, BLOB and TEXT columns are left
+**                 out as well, and if colNames is NULL every other column
+**                 is loaded.  setProjection(NULL) loads every column.
+**
+**                 Returns the number of columns get() will load.
+*/
+
+int ADBTable::setProjection(const char *colNames, int excludeBlobs)
+{
+    int     retVal = 0;
+    memset(projMask, 0, sizeof(projMask));
+    projActive = 0;
+    if (!colNames && !excludeBlobs) return numColumns;
+    if (primaryKeyColumn >= numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::setProjection() - No primary key defined for table '%s'", TableName);
+        return numColumns;
+    }
+
+    if (colNames) {
+        char    colName[ADB_MAXCOLWIDTH];
+        const char *pos = colNames;
+        while (*pos) {
+            // Pull out the next name, without the spaces around it.
+            while (*pos == ' ' || *pos == ',') pos++;
+            uint    nameLen = 0;
+            while (*pos && *pos != ',') {
+                if (nameLen < sizeof(colName) - 1) colName[nameLen++] = *pos;
+                pos++;
+            }
+            while (nameLen && colName[nameLen - 1] == ' ') nameLen--;
+            colName[nameLen] = '\0';
+            if (!nameLen) continue;
+
+            uint    colNo = getColumnNumber(colName);
+            if (colNo < numColumns) {
+                projMask[colNo / 64] |= 1ULL << (colNo % 64);
+            } else {
+                ADBLogMsg(LOG_WARNING, "ADBTable::setProjection() - No column '%s' in table '%s'", colName, TableName);
             }
-            retVal = keyVal;
         }
-
     } else {
-        ADBLogMsg(LOG_WARNING, "ADBTable::get(int) - No primary key defined for table '%s'\n", TableName);
+        for (uint i = 0; i < numColumns; i++) projMask[i / 64] |= 1ULL << (i % 64);
     }
-    
+
+    if (excludeBlobs) {
+        for (uint i = 0; i < numColumns; i++) {
+            switch (columnDefs[i]->DataType()) {
+                case FIELD_TYPE_TINY_BLOB:
+                case FIELD_TYPE_MEDIUM_BLOB:
+                case FIELD_TYPE_LONG_BLOB:
+                case FIELD_TYPE_BLOB:
+                    projMask[i / 64] &= ~(1ULL << (i % 64));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    projMask[primaryKeyColumn / 64] |= 1ULL << (primaryKeyColumn % 64);
+
+    for (uint i = 0; i < numColumns; i++) {
+        if (projMask[i / 64] & (1ULL << (i % 64))) retVal++;
+    }
+    projActive = (uint) retVal < numColumns;
     return retVal;
 }
 
+/*
+** getProjected - The get() for a table with a projection.  Loads the
+**                projected columns and leaves the rest empty until they
+**                are read.  Projected rows aren't put in the row cache.
+*/
+
+long ADBTable::getProjected(long keyVal)
+{
+    sqlBuf.clear();
+    sqlBuf.append("SELECT ");
+    uint    selected = 0;
+    for (uint i = 0; i < numColumns; i++) {
+        if (!(projMask[i / 64] & (1ULL << (i % 64)))) continue;
+        if (selected++) sqlBuf.append(", ");
+        sqlBuf.append(columnDefs[i]->ColumnName());
+    }
+    sqlBuf.append(" FROM ");
+    sqlBuf.append(TableName);
+    sqlBuf.append(" where ");
+    sqlBuf.append(columnDefs[primaryKeyColumn]->ColumnName());
+    sqlBuf.append(" = ");
+    sqlBuf.appendLLong(keyVal);
+
+    if (!query("%s", sqlBuf.data())) return 0;
+    if (!rowCount) {
+        if (!inTransaction()) ADBRowCache::storeMissing(DBHost, DBName, TableName, keyVal, cacheGen);
+        return 0;
+    }
+    getrow();
+
+    const char *rowData[ADB_MAXCOLS];
+    selected = 0;
+    for (uint i = 0; i < numColumns; i++) {
+        rowData[i] = (projMask[i / 64] & (1ULL << (i % 64))) ? curRow[(int) selected++] : NULL;
+    }
+    loadColumns(rowData);
+
+    for (uint w = 0; w < ADB_COLMASK_WORDS; w++) lazyMask[w] = ~projMask[w];
+    for (uint i = numColumns; i < ADB_COLMASK_WORDS * 64; i++) lazyMask[i / 64] &= ~(1ULL << (i % 64));
+    lazyKey = keyVal;
+    return keyVal;
+}
+
+/*
+** loadLazy - Fetches columns the projection left out of the loaded row.
+**            Columns that have been given a value since are skipped.
+*/
+
+void ADBTable::loadLazy(const ullong *colMask)
+{
+    uint    cols[ADB_MAXCOLS];
+    uint    numLazy = 0;
+    for (uint i = 0; i < numColumns; i++) {
+        ullong  bit = 1ULL << (i % 64);
+        if (!(colMask[i / 64] & bit) || !(lazyMask[i / 64] & bit)) continue;
+        lazyMask[i / 64] &= ~bit;
+        if (!columnDefs[i]->ColumnChanged()) cols[numLazy++] = i;
+    }
+    if (!numLazy) return;
+
+    sqlBuf.clear();
+    sqlBuf.append("SELECT ");
+    for (uint i = 0; i < numLazy; i++) {
+        if (i) sqlBuf.append(", ");
+        sqlBuf.append(columnDefs[cols[i]]->ColumnName());
+    }
+    sqlBuf.append(" FROM ");
+    sqlBuf.append(TableName);
+    sqlBuf.append(" where ");
+    sqlBuf.append(columnDefs[primaryKeyColumn]->ColumnName());
+    sqlBuf.append(" = ");
+    sqlBuf.appendLLong(lazyKey);
+
+    ADBDebugMsg(2, "ADBTable::loadLazy() - Fetching %u columns of '%s' row %ld", numLazy, TableName, lazyKey);
+    if (!query("%s", sqlBuf.data()) || !rowCount) return;
+    getrow();
+    for (uint i = 0; i < numLazy; i++) {
+        ADBColumn *col = columnDefs[cols[i]];
+        col->set(curRow[(int) i], 1, col->Encrypted());
+    }
+}
+
+/*
+** loadAllLazy - Fetches every column the projection left out of the
+**               loaded row, i.e. before it is inserted.
+*/
+
+void ADBTable::loadAllLazy(void)
+{
+    for (uint w = 0; w < ADB_COLMASK_WORDS; w++) {
+        if (lazyMask[w]) {
+            ullong  colMask[ADB_COLMASK_WORDS];
+            memcpy(colMask, lazyMask, sizeof(colMask));
+            loadLazy(colMask);
+            return;
+        }
+    }
+}
+
+/*
+** ensureLoaded - Makes sure a column the projection left out has been
+**                fetched before it is read.
+*/
+
+void ADBTable::ensureLoaded(uint colNo)
+{
+    if (lazyMask[colNo / 64] & (1ULL << (colNo % 64))) {
+        ullong  colMask[ADB_COLMASK_WORDS];
+        memset(colMask, 0, sizeof(colMask));
+        colMask[colNo / 64] = 1ULL << (colNo % 64);
+        loadLazy(colMask);
+    }
+}
+
 /*
 ** ins   - Takes the current column and inserts it.  After inserting,
-**         it performs a get() on the data.
+**         it reloads the row as autoGet says (see ADB_AUTOGET_*).
 **
 **         It returns the new primary key value if successful.
 */
 
 long ADBTable::ins(int autoGet)
 {
-    long        retVal = 0;
+    long        retVal = -1;
     ADBDebugMsg(7, "ADBTable::ins() Generating insert string...");
+    loadAllLazy();
     if (numColumns) {
-        // Create an initial buffer to work with.
-        uint       sSize = 4096;
-        char       *insStr = (char *) calloc(sSize + ADB_MAXCOLWIDTH + 32, sizeof(char));
-        const char *tmpStr;
-        uint       tmpLen = 0;
-        
-        sprintf(insStr, "INSERT INTO %s VALUES (", TableName);
-        
-        // Loop through all of our columns and get their values.
+        retVal = stmtIns();
+    }
+    if (retVal == -1) {
+        // Build the statement in our reusable buffer.
+        sqlBuf.clear();
+        sqlBuf.append("INSERT INTO ");
+        sqlBuf.append(TableName);
+        sqlBuf.append(" VALUES (");
         for (uint i = 0; i < numColumns; i++) {
-            tmpStr = columnDefs[i]->insStr();
-            tmpLen = strlen(tmpStr);
-            // Check to see if we need to grow our insert string.
-            if (tmpLen + strlen(insStr) > sSize) {
-                ADBDebugMsg(7, "ADBTable::ins() - growing buffer...");
-                // We need to grow it.
-                char *tmpStr2 = (char *) calloc(sSize + 4096 + ADB_MAXCOLWIDTH + 32 + tmpLen, sizeof(char));
-                sSize += 4096 + tmpLen;
-                strcpy(tmpStr2, insStr);
-                free(insStr);
-                insStr = tmpStr2;
-                ADBDebugMsg(7, "ADBTable::ins() - buffer is now %d bytes long....", sSize);
-            }
-            strcat(insStr, tmpStr);
-
-            // If we're not at the last column, add a field seperator
-            if (i < numColumns - 1) strcat(insStr, ",");
+            if (i) sqlBuf.append(',');
+            columnDefs[i]->appendInsStr(&sqlBuf);
         }
-        
-        // Append the closing paren to complete the command.
-        strcat(insStr, ")");
+        sqlBuf.append(')');
 
         // Insert the row and get the primary key value back.
-        retVal = dbcmd("%s", insStr);
-        
-        // free our work string
-        free(insStr);
-
+        retVal = rawcmd(sqlBuf.data(), sqlBuf.length());
+    }
+    int inserted = retVal >= 0;
+    if (!inserted) retVal = 0;
+    if (inserted && primaryKeyColumn < numColumns) {
+        // The key may have been cached as missing.
+        ADBRowCache::invalidate(DBHost, DBName, TableName, retVal ? retVal : columnDefs[primaryKeyColumn]->toLong());
+    }
+    if (numColumns) {
         // If requested, re-load the row so both row references are complete.
-        if (autoGet) get(retVal);
+        if (autoGet == ADB_AUTOGET_MINIMAL) {
+            if (inserted) retVal = settleIns(retVal);
+        } else if (autoGet) {
+            get(retVal);
+        }
         
         // Now, call the virtual post-insert routine.
         postIns();
@@ -708,6 +982,72 @@ long ADBTable::ins(int autoGet)
     return retVal;
 }
 
+/*
+** settleIns - The ADB_AUTOGET_MINIMAL end of ins().  Fills the auto
+**             increment column in from the insert id, makes the values we
+**             sent the backup and reloads the columns the server may have
+**             set on the way in.  Returns the primary key value.
+*/
+
+long ADBTable::settleIns(long insertId)
+{
+    for (uint i = 0; i < numColumns; i++) {
+        if (insertId > 0 && (columnDefs[i]->ServerSet() & ADB_SRVSET_AUTOINC)) {
+            columnDefs[i]->set(insertId);
+        }
+        columnDefs[i]->promote();
+    }
+
+    long keyVal = insertId;
+    if (primaryKeyColumn < numColumns) keyVal = columnDefs[primaryKeyColumn]->toLong();
+    refetchServerSet(ADB_SRVSET_DEFAULT | ADB_SRVSET_ONUPDATE | ADB_SRVSET_GENERATED, keyVal);
+    return keyVal;
+}
+
+/*
+** refetchServerSet - Reloads the columns that have any of the given
+**                    ADB_SRVSET_* flags from the row with the key keyVal.
+**                    Nothing is sent to the server if there are none.
+**
+**                    Returns 1 if successful.
+*/
+
+int ADBTable::refetchServerSet(int flags, long keyVal)
+{
+    uint    cols[ADB_MAXCOLS];
+    uint    numRefetch = 0;
+    for (uint i = 0; i < numColumns; i++) {
+        if (columnDefs[i]->ServerSet() & flags) cols[numRefetch++] = i;
+    }
+    if (!numRefetch) return 1;
+
+    if (primaryKeyColumn >= numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::refetchServerSet() - No primary key defined for table '%s'", TableName);
+        return 0;
+    }
+
+    sqlBuf.clear();
+    sqlBuf.append("SELECT ");
+    for (uint i = 0; i < numRefetch; i++) {
+        if (i) sqlBuf.append(", ");
+        sqlBuf.append(columnDefs[cols[i]]->ColumnName());
+    }
+    sqlBuf.append(" FROM ");
+    sqlBuf.append(TableName);
+    sqlBuf.append(" where ");
+    sqlBuf.append(columnDefs[primaryKeyColumn]->ColumnName());
+    sqlBuf.append(" = ");
+    sqlBuf.appendLLong(keyVal);
+
+    if (!query("%s", sqlBuf.data()) || !rowCount) return 0;
+    getrow();
+    for (uint i = 0; i < numRefetch; i++) {
+        ADBColumn *col = columnDefs[cols[i]];
+        col->set(curRow[(int) i], 1, col->Encrypted());
+    }
+    return 1;
+}
+
 /*
 ** upd   - Takes the currently loaded row and creates an update query for it
 **         using only the modified columns.  If no columns have been modified,
@@ -722,60 +1062,63 @@ long ADBTable::upd(int autoGet)
     long        retVal = 0;
     ADBDebugMsg(7, "ADBTable::upd() Generating update string...");
     if (numColumns) {
-        // Create an initial buffer to work with.
-        uint       sSize = 4096;
-        char       *updStr = (char *) calloc(sSize + ADB_MAXCOLWIDTH + 32, sizeof(char));
-        const char *tmpStr;
-        uint       tmpLen = 0;
-        int        changedCols = 0;
-        
-        sprintf(updStr, "UPDATE %s SET ", TableName);
-        
-        // Loop through all of our columns and get their values.
+        // Figure out which columns have changed.
+        ullong  colMask[ADB_COLMASK_WORDS];
+        int     changedCols = 0;
+        memset(colMask, 0, sizeof(colMask));
         for (uint i = 0; i < numColumns; i++) {
-            // Only do something if the column data has changed.
             if (columnDefs[i]->ColumnChanged()) {
+                colMask[i / 64] |= 1ULL << (i % 64);
                 changedCols++;
-                tmpStr = columnDefs[i]->insStr();
-                tmpLen = strlen(tmpStr);
-                // Check to see if we need to grow our insert string.
-                if (tmpLen + strlen(updStr) > sSize) {
-                    ADBDebugMsg(7, "ADBTable::upd() - growing buffer...");
-                    // We need to grow it.
-                    char *tmpStr2 = (char *) calloc(sSize + 4096 + ADB_MAXCOLWIDTH + 32 + tmpLen, sizeof(char));
-                    sSize += 4096 + tmpLen;
-                    strcpy(tmpStr2, updStr);
-                    free(updStr);
-                    updStr = tmpStr2;
-                    ADBDebugMsg(7, "ADBTable::ins() - buffer is now %d bytes long....", sSize);
-                }
-                if (changedCols > 1) strcat(updStr, ", ");
-                strcat(updStr, columnDefs[i]->ColumnName());
-                strcat(updStr, " = ");
-                strcat(updStr, tmpStr);
             }
         }
-
-        // Update the row and get the primary key value back.
-        if (changedCols) {
-            strcat(updStr, " where ");
-            strcat(updStr, columnDefs[primaryKeyColumn]->ColumnName());
-            strcat(updStr, " = ");
-            strcat(updStr, columnDefs[primaryKeyColumn]->insStr());
-            retVal = dbcmd("%s", updStr);
+        if (!changedCols) return retVal;
+
+        long stmtRet = stmtUpd(colMask);
+        if (stmtRet < 0) {
+            // Build the statement in our reusable buffer.
+            int        addedCols = 0;
+            sqlBuf.clear();
+            sqlBuf.append("UPDATE ");
+            sqlBuf.append(TableName);
+            sqlBuf.append(" SET ");
             
-            if (!retVal) {
-                // Success.
-                if (autoGet) retVal = get(columnDefs[primaryKeyColumn]->toLong());
-                else retVal = columnDefs[primaryKeyColumn]->toLong();
+            // Loop through all of our columns and add the ones that changed.
+            for (uint i = 0; i < numColumns; i++) {
+                if (colMask[i / 64] & (1ULL << (i % 64))) {
+                    if (addedCols++) sqlBuf.append(", ");
+                    sqlBuf.append(columnDefs[i]->ColumnName());
+                    sqlBuf.append(" = ");
+                    columnDefs[i]->appendInsStr(&sqlBuf);
+                }
             }
 
-            // Now, call the virtual post-insert routine.
-            postUpd();
+            // Update the row.
+            sqlBuf.append(" where ");
+            sqlBuf.append(columnDefs[primaryKeyColumn]->ColumnName());
+            sqlBuf.append(" = ");
+            columnDefs[primaryKeyColumn]->appendInsStr(&sqlBuf);
+            stmtRet = rawcmd(sqlBuf.data(), sqlBuf.length()) >= 0 ? 1 : 0;
         }
-        
-        // free our work string
-        free(updStr);
+        ADBRowCache::invalidate(DBHost, DBName, TableName, columnDefs[primaryKeyColumn]->toLong());
+            
+        if (stmtRet) {
+            // Success.  What we have is what is stored now.
+            for (uint i = 0; i < numColumns; i++) columnDefs[i]->setClean();
+            if (autoGet == ADB_AUTOGET_MINIMAL) {
+                // Keep what we sent and only reload what the server sets.
+                for (uint i = 0; i < numColumns; i++) columnDefs[i]->promote();
+                retVal = columnDefs[primaryKeyColumn]->toLong();
+                refetchServerSet(ADB_SRVSET_ONUPDATE | ADB_SRVSET_GENERATED, retVal);
+            } else if (autoGet) {
+                retVal = get(columnDefs[primaryKeyColumn]->toLong());
+            } else {
+                retVal = columnDefs[primaryKeyColumn]->toLong();
+            }
+        }
+
+        // Now, call the virtual post-insert routine.
+        postUpd();
     }
     return retVal;
 }
@@ -791,7 +1134,6 @@ int ADBTable::del(long keyVal)
 {
     int     retVal  = 0;
     long    pKeyVal = keyVal;
-    char    *delStr = (char *) calloc(4096, sizeof(char));
     
     // Check to see if we were given a key value.
     if (!pKeyVal) {
@@ -803,15 +1145,22 @@ int ADBTable::del(long keyVal)
     }
     
     if (pKeyVal) {
-        sprintf(delStr, "DELETE FROM %s WHERE %s = %ld",
-          TableName,
-          columnDefs[primaryKeyColumn]->ColumnName(),
-          pKeyVal
-        );
-        if (!dbcmd("%s", delStr)) {
-            // postDel();
-            retVal = 1;
+        retVal = stmtDel(pKeyVal);
+        if (retVal < 0) {
+            char    *delStr = (char *) calloc(4096, sizeof(char));
+            sprintf(delStr, "DELETE FROM %s WHERE %s = %ld",
+              TableName,
+              columnDefs[primaryKeyColumn]->ColumnName(),
+              pKeyVal
+            );
+            retVal = 0;
+            if (!dbcmd("%s", delStr)) {
+                // postDel();
+                retVal = 1;
+            }
+            free(delStr);
         }
+        ADBRowCache::invalidate(DBHost, DBName, TableName, pKeyVal);
         postDel();
         
         // Was the key loaded the one we just deleted?  If so
@@ -821,10 +1170,737 @@ int ADBTable::del(long keyVal)
         }
     }
     
-    free(delStr);
     return retVal;
 } 
 
+/*
+** ADBTableKeyCmp - qsort() comparison for an array of keys.
+*/
+
+static int ADBTableKeyCmp(const void *a, const void *b)
+{
+    long ka = *(const long *) a;
+    long kb = *(const long *) b;
+    return (ka > kb) - (ka < kb);
+}
+
+/*
+** ADBTableSortKeys - Returns a sorted copy of keyVals with the duplicates removed,
+**            which the caller must free().  numKeys is set to the number
+**            of keys left.
+*/
+
+static long *ADBTableSortKeys(const long *keyVals, ulong *numKeys)
+{
+    long    *sorted = (long *) calloc(*numKeys ? *numKeys : 1, sizeof(long));
+    memcpy(sorted, keyVals, *numKeys * sizeof(long));
+    qsort(sorted, *numKeys, sizeof(long), ADBTableKeyCmp);
+
+    ulong   unique = 0;
+    for (ulong i = 0; i < *numKeys; i++) {
+        if (!unique || sorted[i] != sorted[unique - 1]) sorted[unique++] = sorted[i];
+    }
+    *numKeys = unique;
+    return sorted;
+}
+
+/*
+** appendKeyList - Appends " where pk IN (...)" for count keys to sqlBuf.
+*/
+
+void ADBTable::appendKeyList(const long *keyVals, ulong count)
+{
+    sqlBuf.append(" where ");
+    sqlBuf.append(columnDefs[primaryKeyColumn]->ColumnName());
+    sqlBuf.append(" IN (");
+    for (ulong i = 0; i < count; i++) {
+        if (i) sqlBuf.append(',');
+        sqlBuf.appendLLong(keyVals[i]);
+    }
+    sqlBuf.append(')');
+}
+
+/*
+** getMany - Loads the rows for a list of keys into rowSet, replacing
+**           anything that was in it.  The keys are sorted so the server
+**           walks the primary key in order, and sent in chunks of
+**           ADB_MANYKEYS_CHUNK.  Keys that aren't found are skipped.
+**
+**           Returns the number of rows loaded, or -1 on error.
+*/
+
+long ADBTable::getMany(const long *keyVals, ulong numKeys, ADBRowSet *rowSet)
+{
+    rowSet->clear();
+    if (!numColumns || primaryKeyColumn >= numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::getMany() - No primary key defined for table '%s'", TableName);
+        return -1;
+    }
+
+    long    *sorted = ADBTableSortKeys(keyVals, &numKeys);
+    long    retVal  = 0;
+    drainStream("getMany()");
+    for (ulong start = 0; start < numKeys; start += ADB_MANYKEYS_CHUNK) {
+        ulong   count = numKeys - start;
+        if (count > ADB_MANYKEYS_CHUNK) count = ADB_MANYKEYS_CHUNK;
+
+        // Ordering by the key keeps the whole set in key order, since the
+        // chunks are too.
+        sqlBuf.clear();
+        sqlBuf.append("SELECT * FROM ");
+        sqlBuf.append(TableName);
+        appendKeyList(sorted + start, count);
+        sqlBuf.append(" ORDER BY ");
+        sqlBuf.append(columnDefs[primaryKeyColumn]->ColumnName());
+
+        MYSQL_RES   *res = NULL;
+        if (mysql_real_query(MySock, sqlBuf.data(), sqlBuf.length()) || !(res = mysql_store_result(MySock))) {
+            ADBLogMsg(LOG_ERR, "ADBTable::getMany() - MySQL error loading rows from '%s': '%s'", TableName, mysql_error(MySock));
+            retVal = -1;
+            break;
+        }
+        if (mysql_num_fields(res) != numColumns) {
+            ADBLogMsg(LOG_ERR, "ADBTable::getMany() - '%s' returned %u columns, expected %u", TableName, mysql_num_fields(res), numColumns);
+            mysql_free_result(res);
+            retVal = -1;
+            break;
+        }
+        rowSet->addResult(res, primaryKeyColumn);
+    }
+    free(sorted);
+
+    if (retVal < 0) rowSet->clear();
+    else retVal = rowSet->count();
+    ADBDebugMsg(1, "ADBTable::getMany() - loaded %ld of %lu rows from '%s'", retVal, numKeys, TableName);
+    return retVal;
+}
+
+/*
+** loadRow - Decodes a row from a set loaded by getMany() into the columns,
+**           decrypting the encrypted ones, as if it had been loaded with
+**           get().
+**
+**           Returns the key of the row, or 0 if there is no such row.
+*/
+
+long ADBTable::loadRow(ADBRowSet *rowSet, ulong rowNo)
+{
+    if (rowNo >= rowSet->count()) return 0;
+    loadColumns(rowSet->row(rowNo));
+    rowCount = 1;
+    return rowSet->key(rowNo);
+}
+
+/*
+** delMany - Deletes the rows for a list of keys, ADB_MANYKEYS_CHUNK at a
+**           time, in key order.  If the row that is loaded is one of
+**           them, the data is cleared.  postDel() is not called.
+**
+**           Returns the number of rows deleted, or -1 on error.
+*/
+
+long ADBTable::delMany(const long *keyVals, ulong numKeys)
+{
+    if (!numColumns || primaryKeyColumn >= numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::delMany() - No primary key defined for table '%s'", TableName);
+        return -1;
+    }
+
+    long    *sorted = ADBTableSortKeys(keyVals, &numKeys);
+    long    retVal  = 0;
+    for (ulong start = 0; start < numKeys; start += ADB_MANYKEYS_CHUNK) {
+        ulong   count = numKeys - start;
+        if (count > ADB_MANYKEYS_CHUNK) count = ADB_MANYKEYS_CHUNK;
+
+        sqlBuf.clear();
+        sqlBuf.append("DELETE FROM ");
+        sqlBuf.append(TableName);
+        appendKeyList(sorted + start, count);
+        if (rawcmd(sqlBuf.data(), sqlBuf.length()) < 0) {
+            // The earlier statements have already deleted their rows, so
+            // report those rather than throwing the count away.
+            ADBLogMsg(LOG_ERR, "ADBTable::delMany() - Stopped after deleting %ld rows from '%s', %lu keys not tried", retVal, TableName, numKeys - start);
+            break;
+        }
+        retVal += (long) mysql_affected_rows(MySock);
+    }
+    for (ulong i = 0; i < numKeys; i++) ADBRowCache::invalidate(DBHost, DBName, TableName, sorted[i]);
+
+    // Was the key loaded one we just deleted?  If so clear our data.
+    long    loadedKey = columnDefs[primaryKeyColumn]->toLong();
+    if (loadedKey && bsearch(&loadedKey, sorted, numKeys, sizeof(long), ADBTableKeyCmp)) {
+        clearData();
+    }
+    free(sorted);
+    return retVal;
+}
+
+/*
+** preparedStmt - Returns the cached prepared statement of the given kind
+**                for the columns in colMask, preparing it if this is the
+**                first time it has been asked for on our connection.
+**
+**                Returns NULL if prepared statements can't be used.
+*/
+
+MYSQL_STMT *ADBTable::preparedStmt(int kind, const ullong *colMask)
+{
+    ADBStmtCache    *cache = statements();
+    if (!cache || primaryKeyColumn >= numColumns) return NULL;
+
+    MYSQL_STMT  *stmt = cache->find(TableName, kind, colMask);
+    if (stmt) return stmt;
+
+    // Not prepared yet.  Build the statement text.
+    uint    sSize = 256 + numColumns * (ADB_MAXCOLWIDTH + 8);
+    char    *sql  = (char *) calloc(sSize, sizeof(char));
+    char    *pos  = sql;
+    const char *pkName = columnDefs[primaryKeyColumn]->ColumnName();
+    switch (kind) {
+        case ADB_STMT_GET:
+            sprintf(sql, "SELECT * FROM %s WHERE %s = ?", TableName, pkName);
+            break;
+
+        case ADB_STMT_INS:
+            pos += sprintf(pos, "INSERT INTO %s VALUES (", TableName);
+            for (uint i = 0; i < numColumns; i++) {
+                pos += sprintf(pos, i ? ",?" : "?");
+            }
+            strcpy(pos, ")");
+            break;
+
+        case ADB_STMT_UPD:
+            pos += sprintf(pos, "UPDATE %s SET ", TableName);
+            for (uint i = 0, n = 0; i < numColumns; i++) {
+                if (!(colMask[i / 64] & (1ULL << (i % 64)))) continue;
+                pos += sprintf(pos, "%s%s = ?", n++ ? ", " : "", columnDefs[i]->ColumnName());
+            }
+            sprintf(pos, " WHERE %s = ?", pkName);
+            break;
+
+        case ADB_STMT_DEL:
+            sprintf(sql, "DELETE FROM %s WHERE %s = ?", TableName, pkName);
+            break;
+    }
+
+    stmt = cache->prepare(TableName, kind, colMask, sql);
+    free(sql);
+    return stmt;
+}
+
+/*
+** bindColumn - Binds the value of a column to parameter paramNo.  Numeric
+**              columns are bound as native numbers, everything else as
+**              the (possibly encrypted) string, so nothing is escaped or
+**              formatted.
+*/
+
+void ADBTable::bindColumn(uint paramNo, uint colNo)
+{
+    MYSQL_BIND  *bind = &stmtData->params[paramNo];
+    ADBColumn   *col  = columnDefs[colNo];
+    memset(bind, 0, sizeof(MYSQL_BIND));
+
+    switch (col->DataType()) {
+        case FIELD_TYPE_TINY:
+        case FIELD_TYPE_SHORT:
+        case FIELD_TYPE_LONG:
+        case FIELD_TYPE_INT24:
+        case FIELD_TYPE_LONGLONG:
+            stmtData->intVals[paramNo] = col->toLLong();
+            bind->buffer_type = MYSQL_TYPE_LONGLONG;
+            bind->buffer      = &stmtData->intVals[paramNo];
+            break;
+
+        case FIELD_TYPE_FLOAT:
+        case FIELD_TYPE_DOUBLE:
+            stmtData->dblVals[paramNo] = col->toDouble();
+            bind->buffer_type = MYSQL_TYPE_DOUBLE;
+            bind->buffer      = &stmtData->dblVals[paramNo];
+            break;
+
+        default:
+            {
+                const char *val = col->storedData();
+                stmtData->lengths[paramNo] = strlen(val);
+                bind->buffer_type   = MYSQL_TYPE_STRING;
+                bind->buffer        = (void *) val;
+                bind->buffer_length = stmtData->lengths[paramNo];
+                bind->length        = &stmtData->lengths[paramNo];
+            }
+            break;
+    }
+}
+
+/*
+** bindKey - Binds a primary key value to parameter paramNo.
+*/
+
+void ADBTable::bindKey(uint paramNo, long keyVal)
+{
+    MYSQL_BIND  *bind = &stmtData->params[paramNo];
+    memset(bind, 0, sizeof(MYSQL_BIND));
+    stmtData->intVals[paramNo] = keyVal;
+    bind->buffer_type = MYSQL_TYPE_LONGLONG;
+    bind->buffer      = &stmtData->intVals[paramNo];
+}
+
+/*
+** stmtGet - The prepared statement version of get().  The result columns
+**           are fetched as strings into buffers that are kept between
+**           calls and grown as needed.
+*/
+
+long ADBTable::stmtGet(long keyVal)
+{
+    ullong  colMask[ADB_COLMASK_WORDS];
+    memset(colMask, 0, sizeof(colMask));
+
+    // No one else is talking to the server while we are.  Drain first,
+    // since preparing the statement needs the connection too.
+    drainStream("get()");
+
+    MYSQL_STMT  *stmt = preparedStmt(ADB_STMT_GET, colMask);
+    if (!stmt) return -1;
+
+    if (mysql_stmt_field_count(stmt) != numColumns) {
+        // The table has changed underneath us.
+        statements()->remove(stmt);
+        return -1;
+    }
+
+    bindKey(0, keyVal);
+    if (mysql_stmt_bind_param(stmt, stmtData->params) || mysql_stmt_execute(stmt)) {
+        ADBLogMsg(LOG_ERR, "ADBTable::get() - Prepared select on '%s' failed: %s", TableName, mysql_stmt_error(stmt));
+        statements()->remove(stmt);
+        return -1;
+    }
+
+    for (uint i = 0; i < numColumns; i++) {
+        if (!stmtData->resBufs[i]) {
+            stmtData->resSizes[i] = 256;
+            stmtData->resBufs[i]  = (char *) calloc(stmtData->resSizes[i], sizeof(char));
+        }
+        MYSQL_BIND  *bind = &stmtData->results[i];
+        memset(bind, 0, sizeof(MYSQL_BIND));
+        bind->buffer_type   = MYSQL_TYPE_STRING;
+        bind->buffer        = stmtData->resBufs[i];
+        bind->buffer_length = stmtData->resSizes[i] - 1;
+        bind->length        = &stmtData->resLens[i];
+        bind->is_null       = &stmtData->resNulls[i];
+        bind->error         = &stmtData->resErrors[i];
+    }
+
+    long    retVal = 0;
+    int     fetchRet = 1;
+    if (!mysql_stmt_bind_result(stmt, stmtData->results) && !mysql_stmt_store_result(stmt)) {
+        fetchRet = mysql_stmt_fetch(stmt);
+    }
+
+    if (!fetchRet || fetchRet == MYSQL_DATA_TRUNCATED) {
+        for (uint i = 0; i < numColumns; i++) {
+            if (stmtData->resErrors[i]) {
+                // The column didn't fit.  Grow the buffer and get it again.
+                free(stmtData->resBufs[i]);
+                stmtData->resSizes[i] = stmtData->resLens[i] + 256;
+                stmtData->resBufs[i]  = (char *) calloc(stmtData->resSizes[i], sizeof(char));
+                stmtData->results[i].buffer        = stmtData->resBufs[i];
+                stmtData->results[i].buffer_length = stmtData->resSizes[i] - 1;
+                mysql_stmt_fetch_column(stmt, &stmtData->results[i], i, 0);
+            }
+            stmtData->resBufs[i][stmtData->resNulls[i] ? 0 : stmtData->resLens[i]] = '\0';
+        }
+
+        // Now, copy the row contents into our internal values.
+        loadColumns(stmtData->resBufs);
+        if (!inTransaction()) ADBRowCache::store(DBHost, DBName, TableName, keyVal, numColumns, stmtData->resBufs, cacheGen);
+        rowCount = 1;
+        retVal   = keyVal;
+    } else if (fetchRet == MYSQL_NO_DATA) {
+        if (!inTransaction()) ADBRowCache::storeMissing(DBHost, DBName, TableName, keyVal, cacheGen);
+        rowCount = 0;
+    } else {
+        ADBLogMsg(LOG_ERR, "ADBTable::get() - Fetch from '%s' failed: %s", TableName, mysql_stmt_error(stmt));
+        rowCount = 0;
+    }
+    mysql_stmt_free_result(stmt);
+
+    return retVal;
+}
+
+/*
+** stmtIns - The prepared statement version of ins().  Returns the new key,
+**           or -2 if the insert failed.
+**
+**           The prepared versions of ins(), upd() and del() aren't used
+**           while recordUpdates() is on, so that syslog gets the whole
+**           statement from the text version.
+*/
+
+long ADBTable::stmtIns(void)
+{
+    if (recordingUpdates()) return -1;
+    drainStream("ins()");
+
+    ullong  colMask[ADB_COLMASK_WORDS];
+    memset(colMask, 0xff, sizeof(colMask));
+    MYSQL_STMT  *stmt = preparedStmt(ADB_STMT_INS, colMask);
+    if (!stmt) return -1;
+
+    for (uint i = 0; i < numColumns; i++) bindColumn(i, i);
+
+    recordUpdate("INSERT (prepared)");
+    if (mysql_stmt_bind_param(stmt, stmtData->params) || mysql_stmt_execute(stmt)) {
+        ADBLogMsg(LOG_ERR, "ADBTable::ins() - Insert into '%s' failed: %s", TableName, mysql_stmt_error(stmt));
+        statements()->remove(stmt);
+        return -2;
+    }
+    long retVal = mysql_stmt_insert_id(stmt);
+    ADBDebugMsg(1, "ADBTable::ins() - prepared insert returned %ld", retVal);
+    return retVal;
+}
+
+/*
+** stmtUpd - The prepared statement version of upd().  Returns 1 on
+**           success, 0 on failure.
+*/
+
+long ADBTable::stmtUpd(const ullong *colMask)
+{
+    if (recordingUpdates()) return -1;
+    drainStream("upd()");
+
+    MYSQL_STMT  *stmt = preparedStmt(ADB_STMT_UPD, colMask);
+    if (!stmt) return -1;
+
+    uint    paramNo = 0;
+    for (uint i = 0; i < numColumns; i++) {
+        if (colMask[i / 64] & (1ULL << (i % 64))) bindColumn(paramNo++, i);
+    }
+    bindColumn(paramNo, primaryKeyColumn);
+
+    recordUpdate("UPDATE (prepared)");
+    if (mysql_stmt_bind_param(stmt, stmtData->params) || mysql_stmt_execute(stmt)) {
+        ADBLogMsg(LOG_ERR, "ADBTable::upd() - Update of '%s' failed: %s", TableName, mysql_stmt_error(stmt));
+        statements()->remove(stmt);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+** stmtDel - The prepared statement version of del().  Returns 1 on
+**           success, 0 on failure.
+*/
+
+int ADBTable::stmtDel(long keyVal)
+{
+    if (recordingUpdates()) return -1;
+    drainStream("del()");
+
+    ullong  colMask[ADB_COLMASK_WORDS];
+    memset(colMask, 0, sizeof(colMask));
+    MYSQL_STMT  *stmt = preparedStmt(ADB_STMT_DEL, colMask);
+    if (!stmt) return -1;
+
+    bindKey(0, keyVal);
+
+    recordUpdate("DELETE (prepared)");
+    if (mysql_stmt_bind_param(stmt, stmtData->params) || mysql_stmt_execute(stmt)) {
+        ADBLogMsg(LOG_ERR, "ADBTable::del() - Delete from '%s' failed: %s", TableName, mysql_stmt_error(stmt));
+        statements()->remove(stmt);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+** appendUpsertClause - Appends the ON DUPLICATE KEY UPDATE clause of an
+**                      upsert, with the columns that have changed or with
+**                      every column but the key.  The key is run through
+**                      LAST_INSERT_ID() so the server reports the key of
+**                      an existing row as the insert id.
+*/
+
+void ADBTable::appendUpsertClause(ADBStmtBuf *sql, int changedOnly)
+{
+    const char  *pkName = columnDefs[primaryKeyColumn]->ColumnName();
+    sql->append(" ON DUPLICATE KEY UPDATE ");
+    for (uint i = 0; i < numColumns; i++) {
+        if (i == primaryKeyColumn) continue;
+        if (changedOnly && !columnDefs[i]->ColumnChanged()) continue;
+        sql->append(columnDefs[i]->ColumnName());
+        sql->append(" = VALUES(");
+        sql->append(columnDefs[i]->ColumnName());
+        sql->append("), ");
+    }
+    sql->append(pkName);
+    sql->append(" = LAST_INSERT_ID(");
+    sql->append(pkName);
+    sql->append(')');
+}
+
+/*
+** upsert - Inserts the current row, or updates the changed columns of the
+**          row that is already there, with a single INSERT ... ON
+**          DUPLICATE KEY UPDATE.  The key column is set to the key of the
+**          row that was inserted or updated.
+**
+**          Returns the key, or 0 if it failed.
+*/
+
+long ADBTable::upsert(int autoGet, int *action)
+{
+    long    retVal = 0;
+    if (action) *action = ADB_UPSERT_FAILED;
+    if (!numColumns || primaryKeyColumn >= numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::upsert() - No primary key defined for table '%s'", TableName);
+        return retVal;
+    }
+
+    // Every column is sent, so fetch any the projection left out.
+    loadAllLazy();
+
+    // Build the statement in our reusable buffer.
+    sqlBuf.clear();
+    sqlBuf.append("INSERT INTO ");
+    sqlBuf.append(TableName);
+    sqlBuf.append(" VALUES (");
+    for (uint i = 0; i < numColumns; i++) {
+        if (i) sqlBuf.append(',');
+        columnDefs[i]->appendInsStr(&sqlBuf);
+    }
+    sqlBuf.append(')');
+    appendUpsertClause(&sqlBuf, 1);
+
+    long    insId = rawcmd(sqlBuf.data(), sqlBuf.length());
+    if (insId < 0) return retVal;
+
+    // One row affected is an insert, two an update, and none an update
+    // that didn't change anything.
+    long    affected = (long) mysql_affected_rows(MySock);
+    int     done     = ADB_UPSERT_UNCHANGED;
+    if (affected == 1) done = ADB_UPSERT_INSERTED;
+    else if (affected == 2) done = ADB_UPSERT_UPDATED;
+    if (action) *action = done;
+
+    // Without an auto increment key, a new row doesn't set the insert id,
+    // but then its key is the one we sent.
+    retVal = insId ? insId : columnDefs[primaryKeyColumn]->toLong();
+    if (columnDefs[primaryKeyColumn]->toLong() != retVal) columnDefs[primaryKeyColumn]->set(retVal);
+    ADBRowCache::invalidate(DBHost, DBName, TableName, retVal);
+
+    if (autoGet == ADB_AUTOGET_MINIMAL && done == ADB_UPSERT_INSERTED) {
+        settleIns(retVal);
+    } else if (autoGet) {
+        get(retVal);
+    } else {
+        for (uint i = 0; i < numColumns; i++) columnDefs[i]->setClean();
+    }
+
+    if (done == ADB_UPSERT_INSERTED) postIns();
+    else postUpd();
+    return retVal;
+}
+
+/*
+** batchBegin - Starts a batch of inserts, or upserts if upsert is set.
+**              Returns 1 if successful.
+*/
+
+int ADBTable::batchBegin(int upsert)
+{
+    if (!numColumns) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::batchBegin() - No table defined");
+        return 0;
+    }
+    if (batchData->open) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::batchBegin() - A batch on '%s' is already open", TableName);
+        return 0;
+    }
+
+    // Find out how big a statement the server will take.
+    drainStream("batchBegin()");
+    batchData->maxPacket = 1024 * 1024;
+    if (!mysql_query(MySock, "SELECT @@max_allowed_packet")) {
+        MYSQL_RES *res = mysql_store_result(MySock);
+        if (res) {
+            MYSQL_ROW row = mysql_fetch_row(res);
+            if (row && row[0]) batchData->maxPacket = strtoul(row[0], NULL, 10);
+            mysql_free_result(res);
+        }
+    }
+    // Leave some room for the protocol overhead.
+    if (batchData->maxPacket > 2048) batchData->maxPacket -= 1024;
+
+    // Upserts finish every statement with the same update clause.
+    batchData->upsert = upsert;
+    batchData->suffix.clear();
+    if (upsert) {
+        appendUpsertClause(&batchData->suffix, 0);
+        if (batchData->maxPacket > batchData->suffix.length()) batchData->maxPacket -= batchData->suffix.length();
+    }
+
+    batchData->sql.clear();
+    batchData->sql.append("INSERT INTO ");
+    batchData->sql.append(TableName);
+    batchData->sql.append(" VALUES ");
+    batchData->prefixLen = batchData->sql.length();
+    batchData->rows      = 0;
+    batchData->inserted  = 0;
+    batchData->updated   = 0;
+    batchData->firstKey  = 0;
+    batchData->lastKey   = 0;
+    batchData->open      = 1;
+    ADBDebugMsg(2, "ADBTable::batchBegin() - Batching %s into '%s', max statement size %lu", upsert ? "upserts" : "inserts", TableName, batchData->maxPacket);
+    return 1;
+}
+
+/*
+** batchAdd - Adds the current column values to the batch.  If the
+**            statement being built is full, it is sent first.
+**
+**            Returns 1 if successful.
+*/
+
+int ADBTable::batchAdd(void)
+{
+    int     retVal = 1;
+    if (!batchData->open) {
+        ADBLogMsg(LOG_WARNING, "ADBTable::batchAdd() - No batch open on '%s'", TableName);
+        return 0;
+    }
+
+    // Build the row on the end of the statement.  The columns do the
+    // encryption and escaping for us.
+    loadAllLazy();
+    ADBStmtBuf  *sql = &batchData->sql;
+    ulong       rowStart = sql->length();
+    if (batchData->rows) sql->append(',');
+    sql->append('(');
+    for (uint i = 0; i < numColumns; i++) {
+        if (i) sql->append(',');
+        columnDefs[i]->appendInsStr(sql);
+    }
+    sql->append(')');
+
+    // If this row pushed us over the limit, send the rows before it and
+    // move it to the start of the next statement.  The row is copied out
+    // first, since sending may add to the end of the statement.
+    if (batchData->rows && sql->length() > batchData->maxPacket) {
+        ulong rowLen = sql->length() - rowStart - 1;
+        batchData->rowBuf.clear();
+        batchData->rowBuf.append(sql->data() + rowStart + 1, rowLen);
+        sql->truncate(rowStart);
+        retVal = batchSend();
+        sql->append(batchData->rowBuf.data(), rowLen);
+    }
+    batchData->rows++;
+
+    return retVal;
+}
+
+/*
+** batchFlush - Sends any rows that are still queued and closes the batch.
+**              Returns the number of rows inserted during the batch.  For
+**              upserts, updated is set to the number of rows that were
+**              already there.
+*/
+
+long ADBTable::batchFlush(long *firstKey, long *lastKey, long *updated)
+{
+    if (firstKey) *firstKey = 0;
+    if (lastKey)  *lastKey  = 0;
+    if (updated)  *updated  = 0;
+    if (!batchData->open) return 0;
+
+    if (batchData->rows) batchSend();
+    batchData->open = 0;
+
+    if (firstKey) *firstKey = batchData->firstKey;
+    if (lastKey)  *lastKey  = batchData->lastKey;
+    if (updated)  *updated  = batchData->updated;
+    ADBDebugMsg(2, "ADBTable::batchFlush() - Inserted %ld rows into '%s'", batchData->inserted, TableName);
+    return batchData->inserted;
+}
+
+/*
+** batchSend - Sends the statement that has been built so far.  With the
+**             default auto increment lock modes the server hands out the
+**             keys for a single statement in one consecutive block that
+**             starts at the insert id.  The range across statements is
+**             only consecutive if no one else is inserting.
+**
+**             Returns 1 if successful.
+*/
+
+int ADBTable::batchSend(void)
+{
+    int     retVal = 0;
+    if (batchData->upsert) batchData->sql.append(batchData->suffix.data(), batchData->suffix.length());
+    long    insId  = rawcmd(batchData->sql.data(), batchData->sql.length());
+    if (insId >= 0 && batchData->upsert) {
+        // Affected rows counts an insert once, a changed row twice and an
+        // unchanged one not at all.  The summary, "Records: N  Duplicates:
+        // N  Warnings: N", only counts the changed rows as duplicates, so
+        // together they give the inserts, and the rest of the rows
+        // already existed.
+        long        records = 0;
+        long        dups    = 0;
+        const char  *info   = mysql_info(MySock);
+        if (info && sscanf(info, "Records: %ld Duplicates: %ld", &records, &dups) == 2) {
+            long    inserted = (long) mysql_affected_rows(MySock) - 2 * dups;
+            batchData->inserted += inserted;
+            batchData->updated  += records - inserted;
+        } else if (batchData->rows == 1) {
+            // The server sends no summary for a single row, so go by the
+            // affected rows as upsert() does: 1 is an insert, and 2 (or 0
+            // if nothing changed) means the row already existed.
+            if (mysql_affected_rows(MySock) == 1) batchData->inserted++;
+            else batchData->updated++;
+        } else {
+            batchData->inserted += batchData->rows;
+        }
+
+        // Any key in the table may have changed.
+        ADBRowCache::invalidateRange(DBHost, DBName, TableName, LONG_MIN, LONG_MAX);
+        retVal = 1;
+    } else if (insId >= 0) {
+        long rows = (long) mysql_affected_rows(MySock);
+        if (insId > 0 && rows > 0) {
+            if (!batchData->firstKey) batchData->firstKey = insId;
+            batchData->lastKey = insId + rows - 1;
+            ADBRowCache::invalidateRange(DBHost, DBName, TableName, insId, insId + rows - 1);
+        } else if (rows > 0) {
+            // We don't know what keys the rows have, so forget any
+            // misses we have cached.
+            ADBRowCache::invalidateRange(DBHost, DBName, TableName, LONG_MIN, LONG_MAX);
+        }
+        batchData->inserted += rows;
+        retVal = 1;
+    }
+
+    // Start the next statement.
+    batchData->sql.truncate(batchData->prefixLen);
+    batchData->rows = 0;
+    return retVal;
+}
+
+/*
+** ADBTable::transactionDone - Drops the table's cached rows after a
+**                             commit.  Our writes invalidated their keys
+**                             as they were sent, but until the commit
+**                             other objects still read, and could cache,
+**                             the old rows.
+*/
+
+void ADBTable::transactionDone(int committed, ulong statements)
+{
+    if (committed && statements) {
+        ADBRowCache::invalidateRange(DBHost, DBName, TableName, LONG_MIN, LONG_MAX);
+    }
+}
+
 /*
 ** ADBTable::setEncryptedColumn() - Tells the ADBColumn that this column
 **                                  is stored in encrypted form.
@@ -857,15 +1933,7 @@ int ADBTable::setEncryptedColumn(const char *colName, int useDefKey)
 
 uint ADBTable::getColumnNumber(const char *colName)
 {
-    uint    retVal = ADB_MAXCOLS;
-    if (numColumns) for (uint i = 0; i < numColumns; i++) {
-        if (!strcmp(columnDefs[i]->ColumnName(), colName)) {
-            // Found it.  Short circuit our loop and exit.
-            retVal = i;
-            i = ADB_MAXCOLS;
-        }
-    }
-    return retVal;
+    return colIndex.find(colName);
 }
 
 
@@ -0,0 +1,98 @@
+/**
+ * ADBTransaction.cpp - A scope guard that keeps a transaction open on an
+ *                      ADB object and rolls it back unless committed.
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <ADB.h>
+
+/*
+** ADBTransaction - Starts a transaction on db, or a savepoint if one is
+**                  already open.
+*/
+
+ADBTransaction::ADBTransaction(ADB *db)
+{
+    txnDB     = db;
+    txnActive = 0;
+    txnNested = 0;
+    spName[0] = '\0';
+
+    if (db->inTransaction()) {
+        txnNested = 1;
+        snprintf(spName, sizeof(spName), "adb_scope_%u", db->txnScopes + 1);
+        txnActive = db->savepoint(spName);
+    } else {
+        txnActive = db->begin();
+    }
+    if (txnActive) db->txnScopes++;
+}
+
+/*
+** ~ADBTransaction - Rolls back whatever wasn't committed.
+*/
+
+ADBTransaction::~ADBTransaction()
+{
+    if (txnActive) rollback();
+}
+
+/*
+** commit - Commits the transaction, or releases our savepoint so the
+**          work becomes part of the enclosing transaction.
+*/
+
+int ADBTransaction::commit(void)
+{
+    if (!txnActive) return 0;
+
+    txnActive = 0;
+    txnDB->txnScopes--;
+    if (txnNested) return txnDB->releaseSavepoint(spName);
+    return txnDB->commit();
+}
+
+/*
+** rollback - Rolls back the transaction, or just the work done since our
+**            savepoint.
+*/
+
+int ADBTransaction::rollback(void)
+{
+    if (!txnActive) return 0;
+
+    txnActive = 0;
+    txnDB->txnScopes--;
+    if (txnNested) return txnDB->rollbackTo(spName) && txnDB->releaseSavepoint(spName);
+    return txnDB->rollback();
+}
+
+/*
+** active - Returns 1 until the guard has been committed or rolled back.
+*/
+
+int ADBTransaction::active(void)
+{
+    return txnActive;
+}
@@ -0,0 +1,176 @@
+/**
+ * adbbench.cpp - Times ADBEscapeString() at each scanner level against
+ *                mysql_escape_string(), and checks they agree.  Doesn't
+ *                need a database.
+ *
+ *                Build with something like:
+ *                  g++ -O2 -I. -o adbbench adbbench.cpp libcistools.a \
+ *                      -lmysqlclient -lpthread
+ *
+ **************************************************************************
+ * Written by R. Marc Lewis,
+ *   Copyright 1998-2010, R. Marc Lewis (marc@CheetahIS.com)
+ *   Copyright 2007-2010, Cheetah Information Systems Inc.
+ **************************************************************************
+ *
+ * This file is part of cistools.
+ *
+ * cistools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * cistools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cistools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ADB.h>
+
+// How many bytes each test escapes in total, spread over its strings.
+#define BenchBytes  (256 * 1024 * 1024)
+
+struct BenchInput {
+    const char  *name;
+    ulong       len;
+    int         everyN;         // Put a special byte every N bytes, 0 = none
+};
+
+static BenchInput benchInputs[] = {
+    { "short clean (16)",       16,     0 },
+    { "name/address (40)",      40,     0 },
+    { "text, rare quote (200)", 200,    97 },
+    { "long clean (4096)",      4096,   0 },
+    { "long, quote per 64",     4096,   64 },
+    { "every 8th special",      4096,   8 },
+    { "all quotes",             4096,   1 },
+    { NULL, 0, 0 }
+};
+
+static const char benchSpecial[] = { '\0', '\n', '\r', '\\', '\'', '"', '\032' };
+
+double now(void);
+void   fillInput(char *buf, BenchInput *in);
+double timeMySQL(char *dst, const char *src, ulong len, ulong reps);
+double timeADB(char *dst, const char *src, ulong len, ulong reps);
+int    checkLevels(void);
+
+int main(int argc, char **argv)
+{
+    const char  *levelNames[] = { "scalar", "sse2", "avx2" };
+    int         best = ADBSetEscapeLevel(-1);
+
+    if (checkLevels()) {
+        printf("ADBEscapeString() doesn't match mysql_escape_string()!\n");
+        return 1;
+    }
+
+    printf("%-24s %10s", "MB/s", "mysql");
+    for (int level = ADB_ESCAPE_SCALAR; level <= best; level++) printf(" %10s", levelNames[level]);
+    printf("\n");
+
+    for (BenchInput *in = benchInputs; in->name; in++) {
+        char    *src  = (char *) calloc(in->len + 1, sizeof(char));
+        char    *dst  = (char *) calloc(in->len * 2 + 1, sizeof(char));
+        ulong   reps  = BenchBytes / in->len;
+        double  mb    = (double) reps * in->len / (1024.0 * 1024.0);
+
+        fillInput(src, in);
+        printf("%-24s %10.0f", in->name, mb / timeMySQL(dst, src, in->len, reps));
+        for (int level = ADB_ESCAPE_SCALAR; level <= best; level++) {
+            ADBSetEscapeLevel(level);
+            printf(" %10.0f", mb / timeADB(dst, src, in->len, reps));
+        }
+        printf("\n");
+
+        free(src);
+        free(dst);
+    }
+    ADBSetEscapeLevel(-1);
+    return 0;
+}
+
+/*
+** now - Returns the time in seconds.
+*/
+
+double now(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+** fillInput - Fills buf with printable text, with a special byte every
+**             everyN bytes.
+*/
+
+void fillInput(char *buf, BenchInput *in)
+{
+    for (ulong i = 0; i < in->len; i++) {
+        if (in->everyN && (i % in->everyN) == (ulong) in->everyN - 1) {
+            buf[i] = in->everyN == 1 ? '\'' : benchSpecial[i % sizeof(benchSpecial)];
+        } else {
+            buf[i] = 'a' + i % 26;
+        }
+    }
+}
+
+double timeMySQL(char *dst, const char *src, ulong len, ulong reps)
+{
+    double  start = now();
+    for (ulong i = 0; i < reps; i++) mysql_escape_string(dst, src, len);
+    return now() - start;
+}
+
+double timeADB(char *dst, const char *src, ulong len, ulong reps)
+{
+    double  start = now();
+    for (ulong i = 0; i < reps; i++) ADBEscapeString(dst, src, len);
+    return now() - start;
+}
+
+/*
+** checkLevels - Escapes random strings at every level and compares them
+**               with mysql_escape_string().  Returns non-zero if any
+**               differ.
+*/
+
+int checkLevels(void)
+{
+    char    src[300];
+    char    want[601];
+    char    got[601];
+    int     best = ADBSetEscapeLevel(-1);
+
+    srand(1);
+    for (int i = 0; i < 20000; i++) {
+        ulong   len = rand() % sizeof(src);
+        for (ulong j = 0; j < len; j++) {
+            // Mostly plain bytes, with runs of specials mixed in.
+            if (rand() % 8) src[j] = (char) (rand() % 256);
+            else src[j] = benchSpecial[rand() % sizeof(benchSpecial)];
+        }
+        ulong   wantLen = mysql_escape_string(want, src, len);
+        for (int level = ADB_ESCAPE_SCALAR; level <= best; level++) {
+            ADBSetEscapeLevel(level);
+            ulong   gotLen = ADBEscapeString(got, src, len);
+            if (gotLen != wantLen || memcmp(got, want, wantLen + 1)) {
+                printf("Mismatch at level %d, length %lu\n", level, len);
+                return 1;
+            }
+        }
+    }
+    ADBSetEscapeLevel(-1);
+    return 0;
+}
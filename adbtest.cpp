@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ADB.h>
 
 #ifdef ADBQT
@@ -45,6 +46,19 @@
 void test1(void);
 void test2(void);
 void test3(void);
+void test4(void);
+void test5(void);
+void test6(void);
+void test7(void);
+void test8(void);
+void test9(void);
+void test10(void);
+void test11(void);
+void test12(void);
+void test13(void);
+void test14(void);
+void test15(void);
+void test16(void);
 
 main(int argc, char **argv)
 {
@@ -65,6 +79,19 @@ main(int argc, char **argv)
     test1();
     test2();
     test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
 }
 
 
@@ -158,5 +185,285 @@ void test3(void)
     for (long liNo = DB1.first(); liNo != 0; liNo = DB1.next()) {
         printf("Descending - Got row %ld from the list...blobfield = '%s'\n", liNo, DB1.getStr("blobfield"));
     }
+    DB2.setPrefetch(10);
+    DB2.getList();
+    for (long liNo = DB2.first(); liNo != 0; liNo = DB2.next()) {
+        printf("Prefetched - Got row %ld from the list...blobfield = '%s'\n", liNo, DB2.getStr("blobfield"));
+    }
+    for (long liNo = DB2.streamList("InternalID > 0", 5); liNo != 0; liNo = DB2.next()) {
+        printf("Streamed - Got row %ld from the list...blobfield = '%s'\n", liNo, DB2.getStr("blobfield"));
+    }
+}
+
+
+void test4(void)
+{
+    ADBPoolStats    stats;
+
+    printf("\nTesting the connection pool...\n");
+    ADBPool::setEnabled(true);
+    ADBPool::setMaxSize(4);
+    printf("Warmed up %d connections.\n", ADBPool::warmUp(2, DBName, DBUser, DBPass, DBHost));
+    for (int i = 0; i < 10; i++) {
+        ADBTable    DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+        DB1.get(1);
+    }
+    ADBPool::getStats(&stats);
+    printf("Pool hits = %ld, misses = %ld, waits = %ld, idle = %ld, in use = %ld\n",
+      stats.hits, stats.misses, stats.waits, stats.idle, stats.inUse);
+    ADBPool::closeIdle();
+    ADBPool::setEnabled(false);
+}
+
+void test5(void)
+{
+    printf("\nStreaming a query...\n");
+    ADB     DB1(DBName, DBUser, DBPass, DBHost);
+    DB1.queryStream("select InternalID, varcharfield from %s order by InternalID", DBTable);
+    while (DB1.getrow()) {
+        printf("Streamed row %ld: InternalID -> '%s'\n", DB1.rowCount, DB1.curRow["InternalID"]);
+    }
+    printf("The stream returned %ld rows.\n", DB1.rowCount);
+
+    printf("Abandoning a stream part way through...\n");
+    DB1.queryStream("select * from %s", DBTable);
+    DB1.getrow();
+    DB1.query("select count(*) from %s", DBTable);
+    DB1.getrow();
+    printf("The table has %s rows.\n", DB1.curRow[0]);
 }
 
+void test6(void)
+{
+    long    firstKey, lastKey;
+
+    printf("\nBatch inserting rows...\n");
+    ADBTable    DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+    DB1.batchBegin();
+    for (int i = 0; i < 1000; i++) {
+        DB1.clearData();
+        DB1.setValue("varcharfield", "batch test");
+        DB1.setValue("blobfield", "Encrypted 'batch' test");
+        DB1.batchAdd();
+    }
+    long rows = DB1.batchFlush(&firstKey, &lastKey);
+    printf("Inserted %ld rows, keys %ld through %ld\n", rows, firstKey, lastKey);
+    if (firstKey) {
+        DB1.get(firstKey);
+        printf("First row blobfield = '%s'\n", DB1.getStr("blobfield"));
+    }
+    DB1.dbcmd("delete from %s where varcharfield = 'batch test'", DBTable);
+}
+
+int test7Row(ADBList *list, long keyVal, void *)
+{
+    return strlen(list->getStr("blobfield")) ? 0 : 1;
+}
+
+void test7Range(const ADBRangeResult *range, void *)
+{
+    printf("Range %u (%ld - %ld): %ld rows, %ld empty blobs\n", range->rangeNo, range->firstKey, range->lastKey, range->rows, range->errors);
+}
+
+void test7(void)
+{
+    ADBParallelStats    stats;
+
+    printf("\nWalking a list on 4 threads...\n");
+    ADBList DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+    DB1.forEachParallel(NULL, 4, test7Row, NULL, test7Range, true, &stats);
+    printf("Walked %ld rows in %u ranges, %ld errors, %u failed ranges\n", stats.rows, stats.ranges, stats.errors, stats.failedRanges);
+}
+
+void test8(void)
+{
+    printf("\nScanning with zero copy rows...\n");
+    ADB     DB1(DBName, DBUser, DBPass, DBHost);
+    DB1.curRow.setZeroCopy(true);
+    DB1.query("select InternalID, blobfield from %s order by InternalID", DBTable);
+    while (DB1.getrow()) {
+        printf("Row %s: blobfield is %lu bytes\n", DB1.curRow["InternalID"], DB1.curRow.col("blobfield")->Length());
+    }
+}
+
+void test9(void)
+{
+    printf("\nConverting a column of dates...\n");
+    ADB     DB1(DBName, DBUser, DBPass, DBHost);
+    DB1.query("select InternalID, now() - interval InternalID hour from %s order by InternalID", DBTable);
+    llong   *epochs = new llong[DB1.rowCount + 1];
+    long    rows = DB1.getEpochs(1, epochs);
+    for (long i = 0; i < rows && DB1.getrow(); i++) {
+        printf("Row %s: '%s' -> %lld (toTime_t %ld)\n", DB1.curRow[0], DB1.curRow[1], epochs[i], (long) DB1.curRow.col(1)->toTime_t());
+    }
+    delete [] epochs;
+}
+
+void test10(void)
+{
+    ADBResultSet    rs;
+
+    printf("\nAggregating a columnar result...\n");
+    ADB     DB1(DBName, DBUser, DBPass, DBHost);
+    DB1.queryColumns(&rs, "select InternalID, length(blobfield) as bloblen from %s", DBTable);
+    uint    idCol = rs.columnNumber("InternalID");
+    printf("%lu rows, InternalID %g through %g, total %lld\n", rs.numRows(), rs.min(idCol), rs.max(idCol), rs.sumInt(idCol));
+
+    ullong  *selection = new ullong[rs.selectionWords() + 1];
+    rs.selectAll(selection);
+    ulong   matched = rs.filter(rs.columnNumber("bloblen"), ADB_RS_GT, 10, selection);
+    printf("%lu rows have blobs longer than 10 bytes, %g bytes in all\n", matched, rs.sum(rs.columnNumber("bloblen"), selection));
+    delete [] selection;
+}
+
+void test11(void)
+{
+    printf("\nInserting and updating without reloading the row...\n");
+    ADBTable     DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+    DB1.clearData();
+    DB1.setValue("blobfield", "Inserted with ADB_AUTOGET_MINIMAL");
+    long    keyVal = DB1.ins(ADB_AUTOGET_MINIMAL);
+    printf("New key %ld, InternalID = '%s', blobfield = '%s'\n", keyVal, DB1.getStr("InternalID"), DB1.getStr("blobfield"));
+    DB1.setValue("blobfield", "Updated with ADB_AUTOGET_MINIMAL");
+    DB1.upd(ADB_AUTOGET_MINIMAL);
+    printf("After update, blobfield = '%s', backup = '%s'\n", DB1.getStr("blobfield"), DB1.getStr("blobfield", 1));
+    DB1.del();
+}
+
+void test12(void)
+{
+    ADBRowSet   rows;
+    long        keys[3];
+
+    printf("\nLoading and deleting rows by key...\n");
+    ADBTable     DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+    for (int i = 0; i < 3; i++) {
+        DB1.clearData();
+        DB1.setValue("blobfield", "A row for getMany()");
+        keys[2 - i] = DB1.ins(ADB_AUTOGET_NONE);
+    }
+    printf("getMany() found %ld rows\n", DB1.getMany(keys, 3, &rows));
+    for (ulong i = 0; i < rows.count(); i++) {
+        long    keyVal = DB1.loadRow(&rows, i);
+        printf("Row %ld: blobfield = '%s'\n", keyVal, DB1.getStr("blobfield"));
+    }
+    printf("delMany() deleted %ld rows\n", DB1.delMany(keys, 3));
+}
+
+void test13(void)
+{
+    ADBRowCacheStats    stats;
+
+    printf("\nCaching rows by primary key...\n");
+    ADBRowCache::enable(DBHost, DBName, DBTable, 1000, 60, 60);
+    ADBTable     DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    for (int i = 0; i < 5; i++) {
+        DB1.get(1);
+        DB1.get(-1);
+    }
+    DB1.clearData();
+    DB1.setValue("blobfield", "A cached row");
+    long    keyVal = DB1.ins();
+    DB1.setValue("blobfield", "A changed cached row");
+    DB1.upd();
+    DB1.get(keyVal);
+    printf("After update, blobfield = '%s'\n", DB1.getStr("blobfield"));
+    DB1.del();
+    printf("get() of the deleted row returned %ld\n", DB1.get(keyVal));
+
+    ADBRowCache::getTableStats(DBHost, DBName, DBTable, &stats);
+    printf("Hits = %lu, negative hits = %lu, misses = %lu, evictions = %lu, expirations = %lu, invalidations = %lu, rows = %lu\n",
+      stats.hits, stats.negativeHits, stats.misses, stats.evictions, stats.expirations, stats.invalidations, stats.rows);
+    ADBRowCache::disable(DBHost, DBName, DBTable);
+}
+
+void test14(void)
+{
+    int     action;
+    long    updated;
+
+    printf("\nUpserting rows...\n");
+    ADBTable     DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+    DB1.clearData();
+    DB1.setValue("varcharfield", "upsert test");
+    DB1.setValue("blobfield", "Upserted once");
+    long    keyVal = DB1.upsert(ADB_AUTOGET_NONE, &action);
+    printf("First upsert: key %ld, action %d\n", keyVal, action);
+    DB1.setValue("blobfield", "Upserted twice");
+    keyVal = DB1.upsert(ADB_AUTOGET_FULL, &action);
+    printf("Second upsert: key %ld, action %d, blobfield = '%s'\n", keyVal, action, DB1.getStr("blobfield"));
+
+    DB1.batchBegin(1);
+    for (int i = 0; i < 10; i++) {
+        DB1.clearData();
+        DB1.setValue("InternalID", i < 5 ? keyVal + i : 0);
+        DB1.setValue("varcharfield", "upsert test");
+        DB1.setValue("blobfield", "Batch upserted");
+        DB1.batchAdd();
+    }
+    long rows = DB1.batchFlush(NULL, NULL, &updated);
+    printf("Batch upsert inserted %ld rows and updated %ld\n", rows, updated);
+    DB1.dbcmd("delete from %s where varcharfield = 'upsert test'", DBTable);
+}
+
+void test15(void)
+{
+    printf("\nLoading rows without their blobs...\n");
+    ADBTable     DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+    printf("get() loads %d columns\n", DB1.setProjection(NULL, 1));
+    DB1.get(1);
+    printf("varcharfield = '%s'\n", DB1.getStr("varcharfield"));
+    printf("blobfield, fetched now = '%s'\n", DB1.getStr("blobfield"));
+    printf("get() loads %d columns\n", DB1.setProjection("varcharfield"));
+    DB1.get(1);
+    DB1.setProjection(NULL);
+}
+
+void test16(void)
+{
+    printf("\nTransactions...\n");
+    ADBTable     DB1(DBTable, DBName, DBUser, DBPass, DBHost);
+    DB1.setEncryptedColumn("blobfield");
+
+    long    keyVal;
+    {
+        ADBTransaction  txn(&DB1);
+        DB1.clearData();
+        DB1.setValue("varcharfield", "transaction test");
+        DB1.setValue("blobfield", "Rolled back");
+        keyVal = DB1.ins();
+    }
+    printf("get() of the rolled back row returned %ld\n", DB1.get(keyVal));
+
+    DB1.begin();
+    DB1.clearData();
+    DB1.setValue("varcharfield", "transaction test");
+    DB1.setValue("blobfield", "Committed");
+    keyVal = DB1.ins();
+    DB1.savepoint("before_upd");
+    DB1.setValue("blobfield", "Rolled back to the savepoint");
+    DB1.upd();
+    DB1.rollbackTo("before_upd");
+    DB1.commit();
+    DB1.get(keyVal);
+    printf("After commit, blobfield = '%s'\n", DB1.getStr("blobfield"));
+
+    DB1.setCommitBatch(100, 500);
+    for (int i = 0; i < 1000; i++) {
+        DB1.clearData();
+        DB1.setValue("varcharfield", "transaction test");
+        DB1.setValue("blobfield", "Batch committed");
+        DB1.ins(ADB_AUTOGET_NONE);
+    }
+    DB1.setCommitBatch(0);
+    DB1.query("select count(*) from %s where varcharfield = 'transaction test'", DBTable);
+    DB1.getrow();
+    printf("Rows after batched commits = %s\n", DB1.curRow[0]);
+    DB1.dbcmd("delete from %s where varcharfield = 'transaction test'", DBTable);
+}